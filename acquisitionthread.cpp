@@ -0,0 +1,83 @@
+/***************************************************************************
+ *   Copyright (C) 2003 by Matthias H. Hennig                              *
+ *   hennig@cn.stir.ac.uk                                                  *
+ *   Copyright (C) 2005 by Bernd Porr                                      *
+ *   mail@berndporr.me.uk                                                  *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#include "acquisitionthread.h"
+
+AcquisitionThread::AcquisitionThread(SampleSource *source, SampleRing *ring) :
+    source(source),
+    ring(ring),
+    numChannels(source->numChannels()),
+    recorder(0),
+    stats(0),
+    running(0),
+    error(0),
+    end(0)
+{
+  scans = new double[ACQ_BLOCK_SCANS * numChannels];
+}
+
+AcquisitionThread::~AcquisitionThread()
+{
+  stop();
+  wait();
+  delete[] scans;
+}
+
+void AcquisitionThread::setRecorder(RecordingWriter *writer)
+{
+  recorderLock.lock();
+  recorder = writer;
+  recorderLock.unlock();
+}
+
+void AcquisitionThread::run()
+{
+  while( running.loadAcquire() )
+  {
+    const void *raw;
+    int64_t t0 = PipelineStats::now();
+    int nScans = source->acquire(&raw, ACQ_BLOCK_SCANS);
+    int64_t t1 = PipelineStats::now();
+    if( nScans < 0 )
+    {
+      if( source->atEnd() )
+        end.storeRelease(1);
+      else
+        error.storeRelease(1);
+      break;
+    }
+    if( nScans == 0 )
+      continue;
+
+    recorderLock.lock();
+    if( recorder )
+      recorder->write(raw, nScans);
+    recorderLock.unlock();
+
+    int64_t t2 = PipelineStats::now();
+    source->decode(raw, nScans, scans);
+    int64_t t3 = PipelineStats::now();
+    source->release(nScans);
+    int n = ring->push(scans, nScans);
+
+    if( stats )
+    {
+      // the read includes waiting for the device
+      stats->record(STAGE_READ, t1 - t0);
+      stats->record(STAGE_DECODE, t3 - t2);
+      stats->arrived(n, t1);
+      int bytes = source->bufferContents();
+      if( bytes >= 0 )
+        stats->bufferLevel(bytes, source->bufferSize());
+    }
+  }
+}
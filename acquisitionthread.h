@@ -0,0 +1,88 @@
+/***************************************************************************
+ *   Copyright (C) 2003 by Matthias H. Hennig                              *
+ *   hennig@cn.stir.ac.uk                                                  *
+ *   Copyright (C) 2005 by Bernd Porr                                      *
+ *   mail@berndporr.me.uk                                                  *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#ifndef ACQUISITIONTHREAD_H
+#define ACQUISITIONTHREAD_H
+
+#include <QThread>
+#include <QAtomicInt>
+#include <QMutex>
+
+#include "samplering.h"
+#include "samplesource.h"
+#include "recordingwriter.h"
+#include "pipelinestats.h"
+
+// maximal number of scans taken from the source at once
+#define ACQ_BLOCK_SCANS 4096
+
+/**
+ * Pulls raw scans from a SampleSource on its own thread, converts
+ * the samples to volts and pushes whole scans into a SampleRing.
+ **/
+class AcquisitionThread : public QThread
+{
+public:
+
+  // the source has to be open() already
+  AcquisitionThread(SampleSource *source, SampleRing *ring);
+  ~AcquisitionThread();
+
+  /// starts the thread, stop() may come before it actually runs
+  void start()
+  {
+    running.storeRelease(1);
+    QThread::start();
+  }
+
+  /// ask the thread to finish, returns without waiting
+  void stop() { running.storeRelease(0); }
+
+  /// set when the source reported an error
+  bool failed() const { return error.loadAcquire() != 0; }
+
+  /// set when a recording has been replayed completely
+  bool atEnd() const { return end.loadAcquire() != 0; }
+
+  /// every raw scan is also passed to the writer, 0 stops that. Once
+  /// this returns the previous writer is no longer used.
+  void setRecorder(RecordingWriter *writer);
+
+  /// read and decode timings and the arrival of the blocks go here,
+  /// has to be set before start()
+  void setStats(PipelineStats *s) { stats = s; }
+
+protected:
+
+  virtual void run();
+
+private:
+
+  SampleSource *source;
+  SampleRing *ring;
+  int numChannels;
+
+  // decoded scans for one block
+  double *scans;
+
+  // held while a block is handed to the recorder
+  QMutex recorderLock;
+  RecordingWriter *recorder;
+
+  PipelineStats *stats;
+
+  QAtomicInt running;
+  QAtomicInt error;
+  QAtomicInt end;
+};
+
+#endif
@@ -0,0 +1,124 @@
+/***************************************************************************
+ *   Copyright (C) 2003 by Matthias H. Hennig                              *
+ *   hennig@cn.stir.ac.uk                                                  *
+ *   Copyright (C) 2005 by Bernd Porr                                      *
+ *   mail@berndporr.me.uk                                                  *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#include "batch.h"
+#include "filesource.h"
+#include "psthprocessor.h"
+
+#include <stdio.h>
+
+#include <QDir>
+#include <QFileInfo>
+#include <QThreadPool>
+
+BatchJob::BatchJob(const QString &filename, const BatchSettings &settings,
+		   QAtomicInt *failures) :
+    filename(filename),
+    settings(settings),
+    failures(failures)
+{
+}
+
+// ms to samples, at least one
+static int toSamples(double ms, double rate)
+{
+  int n = (int)(ms * rate / 1000 + 0.5);
+  return n < 1 ? 1 : n;
+}
+
+void BatchJob::run()
+{
+  QByteArray name = filename.toLocal8Bit();
+  FileSource source(name.constData(), false);
+
+  if( source.open() < 0 )
+  {
+    failures->fetchAndAddRelaxed(1);
+    return;
+  }
+
+  int nChannels = source.numChannels();
+  PsthProcessor processor(nChannels, source.samplingRate());
+  double rate = source.samplingRate();
+  // the mode first, the buffers are checked for it
+  if( !processor.setAverage(settings.average) ||
+      !processor.setPsthLength(toSamples(settings.psthLength, rate)) ||
+      !processor.setBinWidth(toSamples(settings.psthBinw, rate)) )
+  {
+    fprintf(stderr, "%s: the sweep needs too much memory\n", name.constData());
+    failures->fetchAndAddRelaxed(1);
+    return;
+  }
+  processor.setThreshold(settings.spikeThres);
+  processor.setFilter(settings.filter);
+  processor.setNotchFrequency(settings.notchFrequency);
+  processor.setTrigger(settings.triggerChannel, settings.triggerLevel,
+		       settings.preTrigger ? toSamples(settings.preTrigger, rate) : 0);
+  processor.setSmoothing(settings.kernel, settings.kernelWidth * rate / 1000);
+  if( !settings.templates.isEmpty() &&
+      !processor.loadTemplates(settings.templates.toLocal8Bit().constData()) )
+  {
+    failures->fetchAndAddRelaxed(1);
+    return;
+  }
+  processor.start();
+
+  double *scans = new double[PROC_BLOCK_SCANS * nChannels];
+  const void *raw;
+  int nScans;
+
+  while( (nScans = source.acquire(&raw, PROC_BLOCK_SCANS)) >= 0 )
+  {
+    source.decode(raw, nScans, scans);
+    source.release(nScans);
+    processor.process(scans, nScans);
+  }
+  delete[] scans;
+
+  if( !source.atEnd() )
+  {
+    failures->fetchAndAddRelaxed(1);
+    return;
+  }
+
+  QString suffix = settings.npz ? ".npz" : ".psth";
+  QString out = filename + suffix;
+  if( !settings.outDir.isEmpty() )
+    out = QDir(settings.outDir).filePath(QFileInfo(filename).fileName() + suffix);
+
+  QByteArray outName = out.toLocal8Bit();
+  bool saved = settings.npz ? processor.saveNpz(outName.constData())
+    : processor.save(outName.constData());
+  if( !saved )
+  {
+    failures->fetchAndAddRelaxed(1);
+    return;
+  }
+
+  fprintf(stderr, "%s: %d trials\n", name.constData(), processor.trials());
+}
+
+int runBatch(const QStringList &files, const BatchSettings &settings)
+{
+  QAtomicInt failures(0);
+  QThreadPool pool;
+
+  if( settings.jobs > 0 )
+    pool.setMaxThreadCount(settings.jobs);
+
+  // the pool deletes the jobs when they are done
+  for(int i=0; i<files.size(); i++)
+    pool.start(new BatchJob(files.at(i), settings, &failures));
+
+  pool.waitForDone();
+  return failures.loadAcquire();
+}
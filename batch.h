@@ -0,0 +1,97 @@
+/***************************************************************************
+ *   Copyright (C) 2003 by Matthias H. Hennig                              *
+ *   hennig@cn.stir.ac.uk                                                  *
+ *   Copyright (C) 2005 by Bernd Porr                                      *
+ *   mail@berndporr.me.uk                                                  *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <QRunnable>
+#include <QString>
+#include <QStringList>
+#include <QAtomicInt>
+
+#include "notchfilter.h"
+#include "psthprocessor.h"
+
+/**
+ * Analysis parameters for the batch mode, the same as in the GUI.
+ **/
+struct BatchSettings
+{
+  BatchSettings() :
+      psthLength(1000),
+      psthBinw(20),
+      spikeThres(1),
+      filter(false),
+      notchFrequency(NOTCH_F),
+      average(false),
+      triggerChannel(-1),
+      triggerLevel(TRIGGER_LEVEL),
+      preTrigger(0),
+      kernel(KERNEL_NONE),
+      kernelWidth(10),
+      npz(false),
+      jobs(0)
+  {}
+
+  // in ms, converted with the sampling rate of each recording
+  int psthLength;
+  int psthBinw;
+  double spikeThres;
+  bool filter;
+  // mains frequency in Hz
+  double notchFrequency;
+  // VEP instead of PSTH
+  bool average;
+  // channel with the sync pulses, -1 runs free
+  int triggerChannel;
+  double triggerLevel;
+  // in ms
+  int preTrigger;
+  // spike sorting templates, none if empty
+  QString templates;
+  // smoothed rate next to each PSTH, the width in ms
+  SmoothingKernel kernel;
+  double kernelWidth;
+  // directory for the results, next to the recording if empty
+  QString outDir;
+  // NumPy .npz files instead of the text columns
+  bool npz;
+  // number of threads, 0 for one per core
+  int jobs;
+};
+
+/**
+ * Replays one recording as fast as possible through a PsthProcessor
+ * and saves the PSTHs of all channels as "<recording>.psth", or
+ * everything as "<recording>.npz".
+ **/
+class BatchJob : public QRunnable
+{
+public:
+
+  BatchJob(const QString &filename, const BatchSettings &settings,
+	   QAtomicInt *failures);
+
+  virtual void run();
+
+private:
+
+  QString filename;
+  const BatchSettings &settings;
+  // incremented when the file could not be analysed
+  QAtomicInt *failures;
+};
+
+/// analyses all files on a thread pool, returns the number of failures
+int runBatch(const QStringList &files, const BatchSettings &settings);
+
+#endif
@@ -0,0 +1,303 @@
+/***************************************************************************
+ *   Copyright (C) 2003 by Matthias H. Hennig                              *
+ *   hennig@cn.stir.ac.uk                                                  *
+ *   Copyright (C) 2005 by Bernd Porr                                      *
+ *   mail@berndporr.me.uk                                                  *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#include "bench.h"
+#include "syntheticsource.h"
+#include "acquisitionthread.h"
+#include "notchfilter.h"
+#include "spikedetector.h"
+#include "psthprocessor.h"
+#include "pipelinestats.h"
+#include "dataplot.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * Only there for decode(), with the format of the synthetic data but
+ * either sample size.
+ **/
+class BenchSource : public SampleSource
+{
+public:
+
+  BenchSource(int numChannels, double samplingRate, bool lsamplData)
+  {
+    nChannels = numChannels;
+    rate = samplingRate;
+    lsampl = lsamplData;
+    maxdata = 65535;
+    crange.min = -4;
+    crange.max = 4;
+    crange.unit = UNIT_volt;
+  }
+
+  virtual int open() { return 0; }
+  virtual int acquire(const void **, int) { return -1; }
+  virtual void release(int) {}
+};
+
+/**
+ * One case: the same synthetic scans in all the formats the stages
+ * need.
+ **/
+struct BenchData
+{
+  BenchData(int numChannels, double samplingRate, int nScans);
+  ~BenchData();
+
+  int nChannels;
+  double rate;
+  int nScans;
+
+  sampl_t *raw;
+  lsampl_t *lraw;
+  // decoded, interleaved
+  double *scans;
+  // decoded, one row per channel
+  double *rows;
+};
+
+BenchData::BenchData(int numChannels, double samplingRate, int nScans) :
+    nChannels(numChannels),
+    rate(samplingRate),
+    nScans(nScans)
+{
+  int n = nScans * nChannels;
+  raw = new sampl_t[n];
+  lraw = new lsampl_t[n];
+  scans = new double[n];
+  rows = new double[n];
+
+  // Poisson spikes plus noise, the same on every run
+  SyntheticSource source(nChannels, rate, 20, false);
+  source.open();
+  for(int done=0; done<nScans; )
+  {
+    const void *block;
+    int k = source.acquire(&block, nScans - done);
+    memcpy(raw + done * nChannels, block, k * source.scanSize());
+    source.release(k);
+    done += k;
+  }
+
+  for(int i=0; i<n; i++)
+    lraw[i] = raw[i];
+  source.decode(raw, nScans, scans);
+  for(int s=0; s<nScans; s++)
+    for(int c=0; c<nChannels; c++)
+      rows[c * nScans + s] = scans[s * nChannels + c];
+}
+
+BenchData::~BenchData()
+{
+  delete[] raw;
+  delete[] lraw;
+  delete[] scans;
+  delete[] rows;
+}
+
+// one result line, t is the time for nSamples samples in ns
+static void report(const char *stage, int nChannels, double rate,
+		   int length, int64_t t, long int nSamples)
+{
+  if( t < 1 )
+    t = 1;
+  if( length > 0 )
+    printf("%s\t%d\t%g\t%d", stage, nChannels, rate, length);
+  else
+    printf("%s\t%d\t%g\t-", stage, nChannels, rate);
+  printf("\t%.3f\t%.4g\n", (double)t / nSamples, nSamples * 1e9 / t);
+  fflush(stdout);
+}
+
+static int64_t benchDecode(BenchData &d, bool lsampl)
+{
+  BenchSource source(d.nChannels, d.rate, lsampl);
+  const void *raw = lsampl ? (const void *)d.lraw : (const void *)d.raw;
+  double *out = new double[ACQ_BLOCK_SCANS * d.nChannels];
+  // the table is built once per source, not part of the decoding
+  source.prepareDecoder();
+
+  int64_t t0 = PipelineStats::now();
+  for(int s=0; s<d.nScans; s+=ACQ_BLOCK_SCANS)
+  {
+    int n = d.nScans - s < ACQ_BLOCK_SCANS ? d.nScans - s : ACQ_BLOCK_SCANS;
+    source.decode((const char *)raw + (long int)s * source.scanSize(), n, out);
+  }
+  int64_t t = PipelineStats::now() - t0;
+
+  delete[] out;
+  return t;
+}
+
+static int64_t benchNotch(BenchData &d)
+{
+  NotchFilterBank notch(d.nChannels, d.rate);
+  notch.setFrequency(NOTCH_F);
+  double *out = new double[PROC_BLOCK_SCANS * d.nChannels];
+
+  int64_t t0 = PipelineStats::now();
+  for(int s=0; s<d.nScans; s+=PROC_BLOCK_SCANS)
+  {
+    int n = d.nScans - s < PROC_BLOCK_SCANS ? d.nScans - s : PROC_BLOCK_SCANS;
+    notch.process(d.scans + (long int)s * d.nChannels, out, n);
+  }
+  int64_t t = PipelineStats::now() - t0;
+
+  delete[] out;
+  return t;
+}
+
+static int64_t benchDetect(BenchData &d)
+{
+  int crossings[PROC_BLOCK_SCANS];
+  bool *detected = new bool[d.nChannels];
+  for(int c=0; c<d.nChannels; c++)
+    detected[c] = false;
+
+  // in blocks, like the processor does it
+  int64_t t0 = PipelineStats::now();
+  for(int s=0; s<d.nScans; s+=PROC_BLOCK_SCANS)
+  {
+    int n = d.nScans - s < PROC_BLOCK_SCANS ? d.nScans - s : PROC_BLOCK_SCANS;
+    for(int c=0; c<d.nChannels; c++)
+      detectCrossings(d.rows + (long int)c * d.nScans + s, n, 1,
+		      &detected[c], crossings);
+  }
+  int64_t t = PipelineStats::now() - t0;
+
+  delete[] detected;
+  return t;
+}
+
+static int64_t benchProcessor(BenchData &d, int length, int binw, bool vep,
+			      bool sort)
+{
+  PsthProcessor processor(d.nChannels, d.rate);
+  processor.setPsthLength(length);
+  processor.setBinWidth(binw);
+  processor.setThreshold(1);
+  processor.setAverage(vep);
+
+  if( sort )
+  {
+    // one template per channel from the spikes of a first run
+    processor.start();
+    for(int s=0; s<d.nScans; )
+      s += processor.process(d.scans + (long int)s * d.nChannels, d.nScans - s);
+    const SpikeSorter *sorter = processor.sorter();
+    double *shape = new double[sorter->length()];
+    for(int c=0; c<d.nChannels; c++)
+    {
+      double rms;
+      sorter->average(c, SNIPPET_POOL, shape, &rms);
+      processor.addTemplate(c, shape, 3 * rms);
+    }
+    delete[] shape;
+  }
+  processor.start();
+
+  int64_t t0 = PipelineStats::now();
+  for(int s=0; s<d.nScans; )
+    s += processor.process(d.scans + (long int)s * d.nChannels, d.nScans - s);
+  return PipelineStats::now() - t0;
+}
+
+static int64_t benchPlot(BenchData &d, int length)
+{
+  // a typical width, so the min/max columns are realistic
+  DataPlot plot(length, d.rate, 4, -4);
+  plot.resize(640, 200);
+  plot.show();
+
+  int64_t t0 = PipelineStats::now();
+  for(int s=0; s<d.nScans; s++)
+    plot.setNewData(d.rows[s]);
+  return PipelineStats::now() - t0;
+}
+
+void runBench(const BenchSettings &settings)
+{
+  printf("# stage\tchannels\trate\tlength_ms\tns_per_sample\tsamples_per_s\n");
+
+  for(int i=0; i<settings.rates.size(); i++)
+  {
+    double rate = settings.rates.at(i);
+    int nScans = (int)(rate * settings.seconds);
+    if( nScans < 1 )
+      continue;
+
+    for(int j=0; j<settings.channels.size(); j++)
+    {
+      int nChannels = settings.channels.at(j);
+      if( nChannels < 1 )
+	continue;
+      BenchData d(nChannels, rate, nScans);
+      long int nSamples = (long int)nScans * nChannels;
+
+      // the fastest of a few runs, the first one warms up the caches
+      int64_t best[4];
+      for(int k=0; k<4; k++)
+	best[k] = -1;
+      for(int r=0; r<BENCH_REPEATS; r++)
+      {
+	int64_t t[4] = { benchDecode(d, false), benchDecode(d, true),
+			 benchNotch(d), benchDetect(d) };
+	for(int k=0; k<4; k++)
+	  if( best[k] < 0 || t[k] < best[k] )
+	    best[k] = t[k];
+      }
+      report("decode_sampl", nChannels, rate, 0, best[0], nSamples);
+      report("decode_lsampl", nChannels, rate, 0, best[1], nSamples);
+      report("notch", nChannels, rate, 0, best[2], nSamples);
+      report("detect", nChannels, rate, 0, best[3], nSamples);
+
+      for(int l=0; l<settings.lengths.size(); l++)
+      {
+	int lengthMs = settings.lengths.at(l);
+	int length = (int)(lengthMs * rate / 1000 + 0.5);
+	int binw = (int)(settings.psthBinw * rate / 1000 + 0.5);
+	if( length < 1 )
+	  length = 1;
+	if( binw < 1 )
+	  binw = 1;
+
+	int64_t psth = -1, sort = -1, vep = -1, plot = -1;
+	for(int r=0; r<BENCH_REPEATS; r++)
+	{
+	  int64_t t = benchProcessor(d, length, binw, false, false);
+	  if( psth < 0 || t < psth )
+	    psth = t;
+	  t = benchProcessor(d, length, binw, false, true);
+	  if( sort < 0 || t < sort )
+	    sort = t;
+	  t = benchProcessor(d, length, binw, true, false);
+	  if( vep < 0 || t < vep )
+	    vep = t;
+	  // only one channel is shown
+	  if( settings.plot && j == 0 )
+	  {
+	    t = benchPlot(d, length);
+	    if( plot < 0 || t < plot )
+	      plot = t;
+	  }
+	}
+	report("psth", nChannels, rate, lengthMs, psth, nSamples);
+	report("psth_sorted", nChannels, rate, lengthMs, sort, nSamples);
+	report("vep", nChannels, rate, lengthMs, vep, nSamples);
+	if( plot >= 0 )
+	  report("dataplot", 1, rate, lengthMs, plot, nScans);
+      }
+    }
+  }
+}
@@ -0,0 +1,55 @@
+/***************************************************************************
+ *   Copyright (C) 2003 by Matthias H. Hennig                              *
+ *   hennig@cn.stir.ac.uk                                                  *
+ *   Copyright (C) 2005 by Bernd Porr                                      *
+ *   mail@berndporr.me.uk                                                  *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <QList>
+
+// every stage is timed that often, the fastest run counts
+#define BENCH_REPEATS 3
+
+/**
+ * What the benchmark runs: every stage is timed for each combination
+ * of channel count, sampling rate and sweep length.
+ **/
+struct BenchSettings
+{
+  BenchSettings() :
+      seconds(2),
+      psthBinw(20),
+      plot(true)
+  {}
+
+  QList<int> channels;
+  // Hz
+  QList<double> rates;
+  // sweep lengths in ms
+  QList<int> lengths;
+  // synthetic data per case
+  double seconds;
+  // bin width in ms
+  int psthBinw;
+  // also time DataPlot::setNewData(), needs a QApplication
+  bool plot;
+};
+
+/**
+ * Times decoding, the mains filter, the spike detection, the PSTH (also
+ * with one sorting template per channel), the VEP and the raw data
+ * plot on synthetic data, without any hardware.
+ * Prints one line per stage and case with ns per sample and samples
+ * per second (a sample is one value of one channel) to stdout.
+ **/
+void runBench(const BenchSettings &settings);
+
+#endif
@@ -0,0 +1,293 @@
+/***************************************************************************
+ *   Copyright (C) 2003 by Matthias H. Hennig                              *
+ *   hennig@cn.stir.ac.uk                                                  *
+ *   Copyright (C) 2005 by Bernd Porr                                      *
+ *   mail@berndporr.me.uk                                                  *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#include "comedisource.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/select.h>
+#include <sys/mman.h>
+
+ComediSource::ComediSource(const char *filename, double samplingRate,
+			   Backend backend) :
+    filename(filename),
+    requestedRate(samplingRate),
+    backend(backend),
+    dev(0),
+    chanlist(0),
+    block(0),
+    blockSize(0),
+    filled(0),
+    map(0),
+    bufSize(0)
+{
+}
+
+ComediSource::~ComediSource()
+{
+  if( dev )
+  {
+    comedi_cancel(dev, COMEDI_SUB_DEVICE);
+    if( map )
+      munmap((void *)map, bufSize);
+    comedi_close(dev);
+  }
+  delete[] block;
+  delete[] chanlist;
+}
+
+int ComediSource::open()
+{
+  /* open the device */
+  if( (dev = comedi_open(filename)) == 0 )
+  {
+    comedi_perror(filename);
+    return -1;
+  }
+
+  maxdata = comedi_get_maxdata(dev, COMEDI_SUB_DEVICE, 0);
+  crange = *comedi_get_range(dev,COMEDI_SUB_DEVICE,0,0);
+  nChannels = comedi_get_n_channels(dev, COMEDI_SUB_DEVICE);
+
+  chanlist = new unsigned[nChannels];
+
+  /* Set up channel list */
+  for( int i=0; i<nChannels; i++ )
+    chanlist[i] = CR_PACK(i, COMEDI_RANGE_ID, AREF_GROUND);
+
+  int ret = comedi_get_cmd_generic_timed( dev,
+                                          COMEDI_SUB_DEVICE,
+                                          &comediCommand,
+                                          nChannels,
+                                          (int)(1e9/requestedRate) );
+
+  if(ret < 0)
+  {
+    printf("comedi_get_cmd_generic_timed failed\n");
+    return -1;
+  }
+
+  /* Modify parts of the command */
+  comediCommand.chanlist = chanlist;
+  comediCommand.stop_src = TRIG_NONE;
+  comediCommand.stop_arg = 0;
+
+  /* comedi_command_test() tests a command to see if the
+   * trigger sources and arguments are valid for the subdevice.
+   * If a trigger source is invalid, it will be logically ANDed
+   * with valid values (trigger sources are actually bitmasks),
+   * which may or may not result in a valid trigger source.
+   * If an argument is invalid, it will be adjusted to the
+   * nearest valid value.  In this way, for many commands, you
+   * can test it multiple times until it passes.  Typically,
+   * if you can't get a valid command in two tests, the original
+   * command wasn't specified very well. */
+  ret = comedi_command_test(dev, &comediCommand);
+
+  if(ret < 0)
+  {
+    comedi_perror("comedi_command_test");
+    return -1;
+  }
+
+  fprintf(stderr, "first test returned %d\n", ret);
+
+  ret = comedi_command_test(dev, &comediCommand);
+  if(ret < 0)
+  {
+    comedi_perror("comedi_command_test");
+    return -1;
+  }
+
+  fprintf(stderr, "second test returned %d\n", ret);
+
+  if(ret != 0)
+  {
+    fprintf(stderr,"Error preparing command\n");
+    return -1;
+  }
+
+  // the timing is done channel by channel
+  // this means that the actual sampling rate is divided by
+  // number of channels
+  if ((comediCommand.convert_src ==  TRIG_TIMER)&&(comediCommand.convert_arg)) {
+	  rate=(((double)1E9 / comediCommand.convert_arg)/nChannels);
+  }
+  
+  // the timing is done scan by scan (all channels at once)
+  // the sampling rate is equivalent of the scan_begin_arg
+  if ((comediCommand.scan_begin_src ==  TRIG_TIMER)&&(comediCommand.scan_begin_arg)) {
+	  rate=(double)1E9 / comediCommand.scan_begin_arg;
+  }
+
+  int subdev_flags = comedi_get_subdevice_flags(dev, COMEDI_SUB_DEVICE);
+  lsampl = subdev_flags & SDF_LSAMPL;
+
+  // always read whole scans into the block, plus the partial one
+  // left over from the previous read
+  blockSize = (ACQ_BLOCK_BYTES / scanSize() + 1) * scanSize();
+  block = new unsigned char[blockSize];
+
+  bufSize = comedi_get_buffer_size(dev, COMEDI_SUB_DEVICE);
+  if( bufSize < 0 )
+    bufSize = 0;
+
+  if( backend == MmapBackend )
+  {
+    void *m = MAP_FAILED;
+    if( bufSize > 0 )
+      m = mmap(NULL, bufSize, PROT_READ, MAP_SHARED, comedi_fileno(dev), 0);
+    if( m == MAP_FAILED )
+    {
+      perror("mmap");
+      fprintf(stderr, "falling back to read()\n");
+      backend = ReadBackend;
+    }
+    else
+      map = (const unsigned char *)m;
+  }
+
+  /* start the command */
+  ret = comedi_command(dev, &comediCommand);
+  if(ret < 0)
+  {
+    comedi_perror("comedi_command");
+    return -1;
+  }
+
+  return 0;
+}
+
+int ComediSource::waitForData()
+{
+  int fd = comedi_fileno(dev);
+  fd_set rdset;
+  FD_ZERO(&rdset);
+  FD_SET(fd, &rdset);
+
+  struct timeval timeout;
+  timeout.tv_sec = 0;
+  timeout.tv_usec = ACQ_POLL_TIMEOUT * 1000;
+
+  int ret = select(fd + 1, &rdset, NULL, NULL, &timeout);
+  if( ret < 0 )
+  {
+    if( errno == EINTR )
+      return 0;
+    perror("select");
+    return -1;
+  }
+  return ret > 0;
+}
+
+int ComediSource::acquire(const void **data, int maxScans)
+{
+  if( backend == MmapBackend )
+    return acquireMmap(data, maxScans);
+  return acquireRead(data, maxScans);
+}
+
+int ComediSource::acquireRead(const void **data, int maxScans)
+{
+  size_t scan = scanSize();
+
+  if( filled < scan )
+  {
+    int ret = waitForData();
+    if( ret <= 0 )
+      return ret;
+
+    ssize_t n = read(comedi_fileno(dev), block + filled, blockSize - filled);
+    if( n < 0 && (errno == EINTR || errno == EAGAIN) )
+      return 0;
+    if( n <= 0 )
+    {
+      printf("Error: end of Aquisition\n");
+      return -1;
+    }
+    filled += n;
+  }
+
+  int nScans = filled / scan;
+  if( nScans > maxScans )
+    nScans = maxScans;
+
+  *data = block;
+  return nScans;
+}
+
+int ComediSource::acquireMmap(const void **data, int maxScans)
+{
+  int ret = waitForData();
+  if( ret <= 0 )
+    return ret;
+
+  int scan = scanSize();
+  int contents = comedi_get_buffer_contents(dev, COMEDI_SUB_DEVICE);
+  if( contents < 0 )
+  {
+    comedi_perror("comedi_get_buffer_contents");
+    return -1;
+  }
+
+  int nScans = contents / scan;
+  if( nScans == 0 )
+  {
+    // only part of a scan has arrived so far
+    usleep(1000);
+    return 0;
+  }
+  if( nScans > maxScans )
+    nScans = maxScans;
+
+  int offset = comedi_get_buffer_offset(dev, COMEDI_SUB_DEVICE);
+  int contiguous = (bufSize - offset) / scan;
+
+  if( contiguous == 0 )
+  {
+    // this scan is split by the wrap around, glue it together
+    int head = bufSize - offset;
+    memcpy(block, map + offset, head);
+    memcpy(block + head, map, scan - head);
+    *data = block;
+    return 1;
+  }
+
+  // hand out the scans up to the end of the buffer in place
+  if( nScans > contiguous )
+    nScans = contiguous;
+  *data = map + offset;
+  return nScans;
+}
+
+void ComediSource::release(int nScans)
+{
+  size_t used = nScans * scanSize();
+
+  if( backend == MmapBackend )
+  {
+    if( comedi_mark_buffer_read(dev, COMEDI_SUB_DEVICE, used) < 0 )
+      comedi_perror("comedi_mark_buffer_read");
+    return;
+  }
+
+  // keep the incomplete scan for the next round
+  memmove(block, block + used, filled - used);
+  filled -= used;
+}
+
+int ComediSource::bufferContents()
+{
+  return comedi_get_buffer_contents(dev, COMEDI_SUB_DEVICE);
+}
@@ -0,0 +1,77 @@
+/***************************************************************************
+ *   Copyright (C) 2003 by Matthias H. Hennig                              *
+ *   hennig@cn.stir.ac.uk                                                  *
+ *   Copyright (C) 2005 by Bernd Porr                                      *
+ *   mail@berndporr.me.uk                                                  *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#ifndef COMEDISOURCE_H
+#define COMEDISOURCE_H
+
+#include "samplesource.h"
+
+#define COMEDI_SUB_DEVICE  0
+#define COMEDI_RANGE_ID    0    /* +/- 4V */
+
+// size of one read() from the comedi device in bytes
+#define ACQ_BLOCK_BYTES 65536
+
+/**
+ * Streams all channels of an analogue input subdevice with a comedi
+ * command. The data is either fetched with read() or decoded in place
+ * from the mmap()ed comedi buffer.
+ **/
+class ComediSource : public SampleSource
+{
+public:
+
+  enum Backend { ReadBackend, MmapBackend };
+
+  ComediSource(const char *filename, double samplingRate,
+	       Backend backend = ReadBackend);
+  ~ComediSource();
+
+  virtual int open();
+  virtual int acquire(const void **data, int maxScans);
+  virtual void release(int nScans);
+  virtual int bufferContents();
+  virtual int bufferSize() const { return bufSize; }
+
+private:
+
+  // waits up to ACQ_POLL_TIMEOUT for the device, returns 1 when it
+  // has data, 0 on timeout and -1 on error
+  int waitForData();
+
+  int acquireRead(const void **data, int maxScans);
+  int acquireMmap(const void **data, int maxScans);
+
+  const char *filename;
+  double requestedRate;
+  Backend backend;
+
+  /**
+   * file descriptor for /dev/comedi0
+   **/
+  comedi_t *dev;
+  comedi_cmd comediCommand;
+  unsigned *chanlist;
+
+  // raw bytes read from the device, may end in a partial scan, also
+  // used to glue together scans split by the mmap wrap around
+  unsigned char *block;
+  size_t blockSize;
+  size_t filled;
+
+  // the mmap()ed comedi buffer
+  const unsigned char *map;
+  // size of the comedi buffer in bytes
+  int bufSize;
+};
+
+#endif
@@ -10,15 +10,159 @@
 
 #include "dataplot.h"
 
-DataPlot::DataPlot(double *xData, double *yData, int length, 
+RawDataSeries::RawDataSeries(int length, double samplingRate) :
+    capacity(length),
+    pos(0),
+    length(length),
+    min(0),
+    max(0),
+    dt(1000 / samplingRate),
+    columns(1),
+    colMin(0),
+    colMax(0),
+    trimmed(0)
+{
+  data = new double[capacity];
+  for(int i=0; i<capacity; i++)
+    data[i] = 0;
+  rebuild();
+}
+
+RawDataSeries::~RawDataSeries()
+{
+  delete[] data;
+  delete[] colMin;
+  delete[] colMax;
+}
+
+void RawDataSeries::setLength(int length)
+{
+  if( length > capacity )
+  {
+    // keep what we have, oldest first, in front of the next write
+    double *d = new double[length];
+    int extra = length - capacity;
+    for(int i=0; i<extra; i++)
+      d[i] = 0;
+    for(int i=0; i<capacity; i++)
+      d[extra + i] = data[(pos + i) % capacity];
+    delete[] data;
+    data = d;
+    capacity = length;
+    pos = 0;
+  }
+  this->length = length;
+  rebuild();
+}
+
+void RawDataSeries::setColumns(int columns)
+{
+  if( columns < 1 )
+    columns = 1;
+  this->columns = columns;
+  rebuild();
+}
+
+void RawDataSeries::rebuild()
+{
+  perColumn = (length + columns - 1) / columns;
+  // one more for the partly visible bucket at each end
+  nBuckets = columns + 2;
+
+  delete[] colMin;
+  delete[] colMax;
+  colMin = new double[nBuckets];
+  colMax = new double[nBuckets];
+
+  // start counting at the oldest sample shown
+  total = 0;
+  curBucket = -1;
+  fill = 0;
+  // append() moves pos back to where it is now; a window as long as
+  // the buffer starts and ends at the same position
+  pos = pos - length;
+  if( pos < 0 )
+    pos += capacity;
+  for(int i=0; i<length; i++)
+    append(data[pos]);
+  trimmed = 0;
+}
+
+void RawDataSeries::trimFirst() const
+{
+  long int start = total - length;
+  if( perColumn <= 1 || start == trimmed )
+    return;
+  trimmed = start;
+
+  // the samples of the bucket which have scrolled out must not count
+  long int bucket = start / perColumn;
+  long int end = (bucket + 1) * perColumn;
+  if( end > total )
+    end = total;
+  int b = (int)(bucket % nBuckets);
+  int idx = pos - length;
+  if( idx < 0 )
+    idx += capacity;
+  colMin[b] = colMax[b] = data[idx];
+  for(long int k=start+1; k<end; k++)
+  {
+    if( ++idx == capacity )
+      idx = 0;
+    if( data[idx] < colMin[b] )
+      colMin[b] = data[idx];
+    if( data[idx] > colMax[b] )
+      colMax[b] = data[idx];
+  }
+}
+
+size_t RawDataSeries::size() const
+{
+  if( perColumn <= 1 )
+    return length;
+
+  long int first = (total - length) / perColumn;
+  return 2 * (curBucket - first + 1);
+}
+
+QPointF RawDataSeries::sample(size_t i) const
+{
+  if( perColumn <= 1 )
+  {
+    int idx = pos - length + (int)i;
+    if( idx < 0 )
+      idx += capacity;
+    return QPointF(i * dt, data[idx]);
+  }
+
+  // a vertical min/max stroke for each column
+  if( i < 2 )
+    trimFirst();
+  long int start = total - length;
+  long int bucket = start / perColumn + i / 2;
+  int b = (int)(bucket % nBuckets);
+  double x = bucket * perColumn - start;
+  if( x < 0 )
+    x = 0;
+  return QPointF(x * dt, (i & 1) ? colMax[b] : colMin[b]);
+}
+
+QRectF RawDataSeries::boundingRect() const
+{
+  return QRectF(0, min, length * dt, max - min);
+}
+
+DataPlot::DataPlot(int length, double samplingRate,
 		   double maxY, double minY, QWidget *parent) :
     QwtPlot(parent),
-    xData(xData),
-    yData(yData),
     max(maxY),
     min(minY),
-    updateCtr(1)
+    updateCtr(1),
+    scaleUpdatePeriod((int)(SCALE_UPDATE_PERIOD * samplingRate))
 {
+  if( scaleUpdatePeriod < 1 )
+    scaleUpdatePeriod = 1;
+
   setTitle("Raw Data");
   setAxisTitle(QwtPlot::xBottom, "Time/ms");
   setAxisTitle(QwtPlot::yLeft, "ADC value / V");
@@ -28,7 +172,9 @@ DataPlot::DataPlot(double *xData, double *yData, int length,
   // Insert new curve for raw data
   dataCurve = new QwtPlotCurve("Raw Data");
   dataCurve->setPen( QPen(Qt::red, 2) );
-  dataCurve->setRawSamples(xData, yData, length);
+  series = new RawDataSeries(length, samplingRate);
+  series->setBounds(min, max);
+  dataCurve->setData(series);
   psthLength = length;
   dataCurve->attach(this);
 }
@@ -36,27 +182,33 @@ DataPlot::DataPlot(double *xData, double *yData, int length,
 void DataPlot::setPsthLength(int length)
 {
   psthLength = length;
-  dataCurve->setRawSamples(xData, yData, psthLength);
+  series->setLength(psthLength);
   replot();
 }
 
+void DataPlot::resizeEvent(QResizeEvent *e)
+{
+  QwtPlot::resizeEvent(e);
+  series->setColumns(canvas()->width());
+}
+
 void DataPlot::setNewData(double yNew) {
-    memmove( yData, yData+1, (psthLength - 1) * sizeof(yData[0]) );
-    yData[psthLength-1] = yNew;
+    series->append(yNew);
     if (yNew>max) {
 	    max = yNew;
     } else {
-	    max = max - (max-yNew)/SCALE_UPDATE_PERIOD;
+	    max = max - (max-yNew)/scaleUpdatePeriod;
     }
     if (yNew<min) {
 	    min = yNew;
     } else {
-	    min = min - (min-yNew)/SCALE_UPDATE_PERIOD;
+	    min = min - (min-yNew)/scaleUpdatePeriod;
     }
     updateCtr--;
     if (updateCtr==0) {
 	    double d = max - min;
 	    setAxisScale(QwtPlot::yLeft,min-d/10,max+d/10);
-	    updateCtr = SCALE_UPDATE_PERIOD;
+	    series->setBounds(min, max);
+	    updateCtr = scaleUpdatePeriod;
     }
 }
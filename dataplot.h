@@ -13,23 +13,108 @@
 
 #include <qwt/qwt_plot.h>
 #include <qwt/qwt_plot_curve.h>
+#include <qwt/qwt_series_data.h>
 
-// in samples (1sec)
-#define SCALE_UPDATE_PERIOD 1000
+// in seconds
+#define SCALE_UPDATE_PERIOD 1
+
+/// circular buffer of the most recent samples, handed to Qwt as
+/// the last "length" points with the oldest sample at x=0. When the
+/// window holds more samples than the plot has pixel columns, a min/max
+/// envelope with one pair of points per column is handed out instead,
+/// so drawing costs the same no matter how long the sweep is.
+class RawDataSeries : public QwtSeriesData<QPointF>
+{
+public:
+  // x is in ms
+  RawDataSeries(int length, double samplingRate);
+  ~RawDataSeries();
+
+  // the buffer grows if needed
+  void setLength(int length);
+  // number of pixel columns available for drawing
+  void setColumns(int columns);
+  void setBounds(double min, double max) { this->min = min; this->max = max; }
+
+  void append(double y)
+  {
+    data[pos] = y;
+    if( ++pos == capacity )
+      pos = 0;
+    ++total;
+
+    // update the envelope of the column this sample falls into
+    if( fill == 0 )
+    {
+      int b = (int)(++curBucket % nBuckets);
+      colMin[b] = y;
+      colMax[b] = y;
+    }
+    else
+    {
+      int b = (int)(curBucket % nBuckets);
+      if( y < colMin[b] )
+        colMin[b] = y;
+      if( y > colMax[b] )
+        colMax[b] = y;
+    }
+    if( ++fill == perColumn )
+      fill = 0;
+  }
+
+  virtual size_t size() const;
+  virtual QPointF sample(size_t i) const;
+  virtual QRectF boundingRect() const;
+
+private:
+  // recomputes the envelope from the raw samples
+  void rebuild();
+  // recomputes the oldest bucket from its samples which are still shown
+  void trimFirst() const;
+
+  double *data;
+  int capacity;
+  // next write position
+  int pos;
+  // number of samples shown
+  int length;
+  double min, max;
+  // ms per sample
+  double dt;
+
+  // samples appended since the last rebuild
+  long int total;
+
+  // min/max envelope, one bucket of perColumn samples per column
+  int columns;
+  int perColumn;
+  int nBuckets;
+  double *colMin, *colMax;
+  // running bucket number of the newest sample
+  long int curBucket;
+  // samples already in the newest bucket
+  int fill;
+  // oldest sample shown when the oldest bucket was last trimmed
+  mutable long int trimmed;
+};
 
 /// this plot shows the raw input data (spikes or membrane potential)
 class DataPlot : public QwtPlot
 {
 public:
 
-	DataPlot(double *xData, double *yData, int length, 
+	DataPlot(int length, double samplingRate,
 		 double max, double min, 
 		 QWidget *parent = 0);
   void setPsthLength(int length);
   void setNewData(double yNew);
 
+protected:
+  virtual void resizeEvent(QResizeEvent *e);
+
 private:
-  double *xData, *yData;
+  // owned by the curve
+  RawDataSeries *series;
 
   // number of data points
   int psthLength;
@@ -38,6 +123,8 @@ private:
 
   double max,min;
   int updateCtr;
+  // samples between rescaling the y axis
+  int scaleUpdatePeriod;
 };
 
 #endif
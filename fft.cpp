@@ -0,0 +1,98 @@
+/***************************************************************************
+ *   Copyright (C) 2003 by Matthias H. Hennig                              *
+ *   hennig@cn.stir.ac.uk                                                  *
+ *   Copyright (C) 2005 by Bernd Porr                                      *
+ *   mail@berndporr.me.uk                                                  *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#include "fft.h"
+
+#include <math.h>
+
+RealFft::RealFft(int n) :
+    n(n),
+    half(n / 2)
+{
+  bitrev = new int[half];
+  int bits = 0;
+  while( (1 << bits) < half )
+    bits++;
+  for(int m=0; m<half; m++)
+  {
+    int r = 0;
+    for(int b=0; b<bits; b++)
+      if( m & (1 << b) )
+	r |= 1 << (bits - 1 - b);
+    bitrev[m] = r;
+  }
+
+  wr = new double[half + 1];
+  wi = new double[half + 1];
+  for(int k=0; k<=half; k++)
+  {
+    wr[k] = cos(2 * M_PI * k / n);
+    wi[k] = -sin(2 * M_PI * k / n);
+  }
+
+  zr = new double[half];
+  zi = new double[half];
+}
+
+RealFft::~RealFft()
+{
+  delete[] bitrev;
+  delete[] wr;
+  delete[] wi;
+  delete[] zr;
+  delete[] zi;
+}
+
+void RealFft::transform(const double *in, double *re, double *im)
+{
+  // even samples are the real, odd ones the imaginary parts
+  for(int m=0; m<half; m++)
+  {
+    zr[bitrev[m]] = in[2*m];
+    zi[bitrev[m]] = in[2*m + 1];
+  }
+
+  // butterflies, exp(-2 pi i j/len) is w[j * n/len]
+  for(int len=2; len<=half; len<<=1)
+  {
+    int step = n / len;
+    int h = len / 2;
+    for(int s=0; s<half; s+=len)
+      for(int j=0; j<h; j++)
+      {
+	double cr = wr[j * step];
+	double ci = wi[j * step];
+	int a = s + j;
+	int b = a + h;
+	double tr = zr[b] * cr - zi[b] * ci;
+	double ti = zr[b] * ci + zi[b] * cr;
+	zr[b] = zr[a] - tr;
+	zi[b] = zi[a] - ti;
+	zr[a] += tr;
+	zi[a] += ti;
+      }
+  }
+
+  // the spectra of the even (e) and odd (o) samples follow from Z[k]
+  // and Z[half-k], X[k] = E[k] + exp(-2 pi i k/n) O[k]
+  for(int k=0; k<=half; k++)
+  {
+    int k1 = k < half ? k : 0;
+    int k2 = k > 0 ? half - k : 0;
+    double a = zr[k1], b = zi[k1];
+    double c = zr[k2], d = zi[k2];
+    double er = (a + c) / 2, ei = (b - d) / 2;
+    double or_ = (b + d) / 2, oi = (c - a) / 2;
+    re[k] = er + wr[k] * or_ - wi[k] * oi;
+    im[k] = ei + wr[k] * oi + wi[k] * or_;
+  }
+}
@@ -0,0 +1,53 @@
+/***************************************************************************
+ *   Copyright (C) 2003 by Matthias H. Hennig                              *
+ *   hennig@cn.stir.ac.uk                                                  *
+ *   Copyright (C) 2005 by Bernd Porr                                      *
+ *   mail@berndporr.me.uk                                                  *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#ifndef FFT_H
+#define FFT_H
+
+/**
+ * FFT of n real samples, n a power of two of at least 4. The samples
+ * are packed into n/2 complex values, transformed with an iterative
+ * radix-2 FFT and the spectrum is unpacked from that. The bit reversal
+ * and the twiddle factors are worked out once in the constructor, a
+ * transform() allocates nothing. One plan can only be used by one
+ * thread at a time.
+ **/
+class RealFft
+{
+public:
+
+  RealFft(int n);
+  ~RealFft();
+
+  int size() const { return n; }
+
+  /// re and im get the n/2+1 bins from DC to Nyquist of in
+  void transform(const double *in, double *re, double *im);
+
+private:
+
+  int n;
+  int half;
+
+  // bit reversed index of each of the half complex values
+  int *bitrev;
+  // exp(-2 pi i k/n) for k up to n/2, the complex FFT of size half
+  // uses every second one
+  double *wr;
+  double *wi;
+
+  // the packed samples
+  double *zr;
+  double *zi;
+};
+
+#endif
@@ -0,0 +1,191 @@
+/***************************************************************************
+ *   Copyright (C) 2003 by Matthias H. Hennig                              *
+ *   hennig@cn.stir.ac.uk                                                  *
+ *   Copyright (C) 2005 by Bernd Porr                                      *
+ *   mail@berndporr.me.uk                                                  *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#include "filesource.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static double now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+FileSource::FileSource(const char *filename, bool realtime) :
+    filename(strdup(filename)),
+    realtime(realtime),
+    f(0),
+    eof(false),
+    buffer(0),
+    chunkScans(0),
+    chunkPos(0),
+    nextScan(0),
+    gapEnd(0),
+    startTime(0),
+    delivered(0)
+{
+}
+
+FileSource::~FileSource()
+{
+  if( f )
+    fclose(f);
+  delete[] buffer;
+  free(filename);
+}
+
+int FileSource::open()
+{
+  if( (f = fopen(filename, "rb")) == 0 )
+  {
+    perror(filename);
+    return -1;
+  }
+
+  memset(&header, 0, sizeof(header));
+  if( fread(&header, 1, sizeof(header), f) != sizeof(header) ||
+      memcmp(header.magic, RECORDING_MAGIC, sizeof(header.magic)) != 0 )
+  {
+    fprintf(stderr, "%s: not a physio_psth recording\n", filename);
+    return -1;
+  }
+  if( header.headerSize < sizeof(header) || header.numChannels == 0 ||
+      (header.sampleSize != sizeof(sampl_t) &&
+       header.sampleSize != sizeof(lsampl_t)) ||
+      header.chunkScans == 0 || !(header.samplingRate > 0) )
+  {
+    fprintf(stderr, "%s: corrupt recording header\n", filename);
+    return -1;
+  }
+  // skip header fields added by later versions
+  if( fseek(f, header.headerSize, SEEK_SET) != 0 )
+  {
+    perror(filename);
+    return -1;
+  }
+
+  nChannels = header.numChannels;
+  rate = header.samplingRate;
+  lsampl = header.sampleSize == sizeof(lsampl_t);
+  maxdata = header.maxdata;
+  crange.min = header.rangeMin;
+  crange.max = header.rangeMax;
+  crange.unit = header.rangeUnit;
+
+  buffer = new unsigned char[(size_t)header.chunkScans * scanSize()];
+  startTime = now();
+
+  return 0;
+}
+
+bool FileSource::readChunk()
+{
+  // the index follows the last chunk
+  if( header.indexOffset && (uint64_t)ftell(f) >= header.indexOffset )
+    return false;
+
+  RecordingChunk chunk;
+  if( fread(&chunk, 1, sizeof(chunk), f) != sizeof(chunk) ||
+      chunk.magic != RECORDING_CHUNK_MAGIC ||
+      chunk.nScans > header.chunkScans )
+    return false;
+
+  // scans the recorder had to drop leave a gap before the chunk, which
+  // is filled so that the sample times stay true
+  if( chunk.firstScan > nextScan )
+  {
+    if( chunk.firstScan != gapEnd )
+    {
+      fprintf(stderr, "%s: %llu scans missing before scan %llu, "
+	      "filled with mid-scale\n", filename,
+	      (unsigned long long)(chunk.firstScan - nextScan),
+	      (unsigned long long)chunk.firstScan);
+      gapEnd = chunk.firstScan;
+    }
+    // the chunk is read again once the gap is filled
+    if( fseek(f, -(long)sizeof(chunk), SEEK_CUR) != 0 )
+    {
+      perror(filename);
+      return false;
+    }
+    fillGap(chunk.firstScan - nextScan);
+    return true;
+  }
+
+  size_t n = fread(buffer, scanSize(), chunk.nScans, f);
+  chunkScans = n;
+  chunkPos = 0;
+  nextScan += n;
+  return n > 0;
+}
+
+void FileSource::fillGap(uint64_t n)
+{
+  if( n > header.chunkScans )
+    n = header.chunkScans;
+
+  int nSamples = (int)n * nChannels;
+  if( lsampl )
+  {
+    lsampl_t *s = (lsampl_t *)buffer;
+    for(int i=0; i<nSamples; i++)
+      s[i] = maxdata / 2;
+  }
+  else
+  {
+    sampl_t *s = (sampl_t *)buffer;
+    for(int i=0; i<nSamples; i++)
+      s[i] = (sampl_t)(maxdata / 2);
+  }
+
+  chunkScans = (int)n;
+  chunkPos = 0;
+  nextScan += n;
+}
+
+int FileSource::acquire(const void **data, int maxScans)
+{
+  if( chunkPos == chunkScans && !readChunk() )
+  {
+    eof = true;
+    return -1;
+  }
+
+  int nScans = chunkScans - chunkPos;
+  if( nScans > maxScans )
+    nScans = maxScans;
+
+  if( realtime )
+  {
+    // hand out about 10ms at a time, like a device would
+    int slice = (int)(rate / 100) + 1;
+    if( nScans > slice )
+      nScans = slice;
+
+    double wait = (delivered + nScans) / rate - (now() - startTime);
+    if( wait > 0 )
+      usleep((useconds_t)(wait * 1e6));
+  }
+
+  *data = buffer + (size_t)chunkPos * scanSize();
+  return nScans;
+}
+
+void FileSource::release(int nScans)
+{
+  chunkPos += nScans;
+  delivered += nScans;
+}
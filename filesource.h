@@ -0,0 +1,64 @@
+/***************************************************************************
+ *   Copyright (C) 2003 by Matthias H. Hennig                              *
+ *   hennig@cn.stir.ac.uk                                                  *
+ *   Copyright (C) 2005 by Bernd Porr                                      *
+ *   mail@berndporr.me.uk                                                  *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#ifndef FILESOURCE_H
+#define FILESOURCE_H
+
+#include <stdio.h>
+
+#include "samplesource.h"
+#include "recording.h"
+
+/**
+ * Replays a raw data recording (see recording.h), either paced at the
+ * recorded sampling rate or as fast as the consumer can take it.
+ **/
+class FileSource : public SampleSource
+{
+public:
+
+  FileSource(const char *filename, bool realtime = true);
+  ~FileSource();
+
+  virtual int open();
+  virtual int acquire(const void **data, int maxScans);
+  virtual void release(int nScans);
+  virtual bool atEnd() const { return eof; }
+
+private:
+
+  // loads the next chunk into the buffer, false at the end
+  bool readChunk();
+  // fills the buffer with up to n scans of mid-scale codes
+  void fillGap(uint64_t n);
+
+  char *filename;
+  bool realtime;
+  FILE *f;
+  RecordingHeader header;
+  bool eof;
+
+  // the current chunk
+  unsigned char *buffer;
+  int chunkScans;
+  int chunkPos;
+  // scans taken from the file so far, including filled gaps
+  uint64_t nextScan;
+  // start of the chunk after the last gap reported
+  uint64_t gapEnd;
+
+  // for pacing in real time
+  double startTime;
+  long int delivered;
+};
+
+#endif
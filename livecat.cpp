@@ -0,0 +1,95 @@
+/***************************************************************************
+ *   Copyright (C) 2003 by Matthias H. Hennig                              *
+ *   hennig@cn.stir.ac.uk                                                  *
+ *   Copyright (C) 2005 by Bernd Porr                                      *
+ *   mail@berndporr.me.uk                                                  *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+/*
+ * Example of a process reading the live data of physio_psth, started
+ * with "--publish /physio_psth":
+ *
+ *   livecat                    once a second the scans and spikes per
+ *                              channel which arrived
+ *   livecat /physio_psth 3     the samples of channel 3 as ASCII
+ *
+ * It needs no Qt: g++ -o livecat livecat.cpp livereader.cpp -lrt
+ */
+
+#include "livereader.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// scans and events taken at once
+#define LIVECAT_BLOCK 4096
+
+int main(int argc, char **argv)
+{
+  const char *name = argc > 1 ? argv[1] : "/physio_psth";
+  int channel = argc > 2 ? atoi(argv[2]) : -1;
+
+  LiveReader reader;
+  if( !reader.attach(name) )
+    return 1;
+
+  int nChannels = reader.numChannels();
+  double rate = reader.samplingRate();
+  if( channel >= nChannels )
+  {
+    fprintf(stderr, "there are only %d channels\n", nChannels);
+    return 1;
+  }
+  fprintf(stderr, "%d channels at %g Hz\n", nChannels, rate);
+
+  double *scans = new double[LIVECAT_BLOCK * nChannels];
+  LiveEvent *events = new LiveEvent[LIVECAT_BLOCK];
+  long int *spikes = new long int[nChannels];
+  for(int c=0; c<nChannels; c++)
+    spikes[c] = 0;
+  long int received = 0;
+  uint64_t lastSecond = reader.nextScan();
+
+  for(;;)
+  {
+    int n = reader.readScans(scans, LIVECAT_BLOCK);
+    // lost scans are skipped, so these are the last n before the next
+    uint64_t first = reader.nextScan() - n;
+    if( channel >= 0 )
+      for(int i=0; i<n; i++)
+	printf("%f\t%f\n", (first + i) / rate, scans[i * nChannels + channel]);
+    received += n;
+
+    int e = reader.readEvents(events, LIVECAT_BLOCK);
+    for(int i=0; i<e; i++)
+      if( events[i].train < (uint32_t)nChannels )
+	spikes[events[i].train]++;
+
+    if( channel < 0 && reader.nextScan() - lastSecond >= rate )
+    {
+      printf("scan %llu: %ld scans, %llu lost, spikes",
+	     (unsigned long long)reader.nextScan(), received,
+	     (unsigned long long)reader.lostScans());
+      for(int c=0; c<nChannels; c++)
+      {
+	printf(" %ld", spikes[c]);
+	spikes[c] = 0;
+      }
+      printf("\n");
+      fflush(stdout);
+      received = 0;
+      lastSecond = reader.nextScan();
+    }
+
+    if( n == 0 && e == 0 )
+      usleep(10000);
+  }
+
+  return 0;
+}
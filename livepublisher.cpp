@@ -0,0 +1,155 @@
+/***************************************************************************
+ *   Copyright (C) 2003 by Matthias H. Hennig                              *
+ *   hennig@cn.stir.ac.uk                                                  *
+ *   Copyright (C) 2005 by Bernd Porr                                      *
+ *   mail@berndporr.me.uk                                                  *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#include "livepublisher.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+// next power of two of at least n
+static uint32_t powerOfTwo(double n)
+{
+  uint32_t p = 1;
+  while( p < n )
+    p <<= 1;
+  return p;
+}
+
+LivePublisher::LivePublisher(int numChannels, int unitsPerChannel,
+			     double samplingRate) :
+    nChannels(numChannels),
+    unitsPerChannel(unitsPerChannel),
+    rate(samplingRate),
+    name(0),
+    segment(0),
+    segmentSize(0),
+    header(0),
+    scanData(0),
+    eventData(0),
+    scanMask(0),
+    eventMask(0),
+    written(0),
+    events(0)
+{
+}
+
+LivePublisher::~LivePublisher()
+{
+  if( segment )
+  {
+    munmap(segment, segmentSize);
+    // the readers keep their mapping until they detach
+    shm_unlink(name);
+  }
+  delete[] name;
+}
+
+bool LivePublisher::open(const char *n)
+{
+  uint32_t scanCapacity = powerOfTwo(rate * LIVE_SECONDS);
+  uint32_t eventCapacity = powerOfTwo(LIVE_EVENTS);
+  size_t scanOffset = sizeof(LiveHeader);
+  size_t eventOffset = scanOffset +
+    (size_t)scanCapacity * nChannels * sizeof(double);
+  segmentSize = eventOffset + (size_t)eventCapacity * sizeof(LiveEvent);
+
+  // a segment left behind by a crash is replaced, readers still
+  // attached to it just see no more data
+  shm_unlink(n);
+  int fd = shm_open(n, O_CREAT | O_EXCL | O_RDWR, 0644);
+  if( fd < 0 )
+  {
+    perror(n);
+    return false;
+  }
+  if( ftruncate(fd, segmentSize) < 0 )
+  {
+    perror("ftruncate");
+    ::close(fd);
+    shm_unlink(n);
+    return false;
+  }
+  void *m = mmap(NULL, segmentSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if( m == MAP_FAILED )
+  {
+    perror("mmap");
+    shm_unlink(n);
+    return false;
+  }
+
+  name = new char[strlen(n) + 1];
+  strcpy(name, n);
+  segment = (unsigned char *)m;
+  header = (LiveHeader *)segment;
+  scanData = (double *)(segment + scanOffset);
+  eventData = (LiveEvent *)(segment + eventOffset);
+  scanMask = scanCapacity - 1;
+  eventMask = eventCapacity - 1;
+
+  // ftruncate() has zeroed everything
+  header->version = LIVE_VERSION;
+  header->headerSize = sizeof(LiveHeader);
+  header->numChannels = nChannels;
+  header->unitsPerChannel = unitsPerChannel;
+  header->samplingRate = rate;
+  header->scanCapacity = scanCapacity;
+  header->eventCapacity = eventCapacity;
+  header->scanOffset = scanOffset;
+  header->eventOffset = eventOffset;
+  header->segmentSize = segmentSize;
+  // readers check the magic, so it comes last
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  memcpy(header->magic, LIVE_MAGIC, sizeof(header->magic));
+
+  return true;
+}
+
+void LivePublisher::publish(const double *scans, int nScans)
+{
+  if( !segment )
+    return;
+
+  // in quarters of the ring at most, see livestream.h
+  int quarter = (scanMask + 1) / 4;
+  int done = 0;
+  while( done < nScans )
+  {
+    uint32_t slot = (uint32_t)written & scanMask;
+    int n = nScans - done;
+    if( n > quarter )
+      n = quarter;
+    if( n > (int)(scanMask + 1 - slot) )
+      n = scanMask + 1 - slot;
+    memcpy(scanData + (size_t)slot * nChannels, scans + (size_t)done * nChannels,
+	   (size_t)n * nChannels * sizeof(double));
+    done += n;
+    written += n;
+    liveStore(&header->scansWritten, written);
+  }
+}
+
+void LivePublisher::publishEvent(uint64_t scan, int train)
+{
+  if( !segment )
+    return;
+
+  LiveEvent *e = eventData + ((uint32_t)events & eventMask);
+  e->scan = scan;
+  e->train = train;
+  e->reserved = 0;
+  events++;
+  liveStore(&header->eventsWritten, events);
+}
@@ -0,0 +1,72 @@
+/***************************************************************************
+ *   Copyright (C) 2003 by Matthias H. Hennig                              *
+ *   hennig@cn.stir.ac.uk                                                  *
+ *   Copyright (C) 2005 by Bernd Porr                                      *
+ *   mail@berndporr.me.uk                                                  *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#ifndef LIVEPUBLISHER_H
+#define LIVEPUBLISHER_H
+
+#include <stddef.h>
+
+#include "livestream.h"
+
+// seconds of scans kept for the readers
+#define LIVE_SECONDS 4
+// spikes kept for the readers
+#define LIVE_EVENTS 65536
+
+/**
+ * Puts the scans and spikes into a POSIX shared memory segment (see
+ * livestream.h) which any number of local processes can map read-only
+ * with a LiveReader. Nobody waits for the readers: a reader which
+ * falls behind by more than the rings hold loses data and can tell
+ * from the counters. The segment is removed again by the destructor.
+ **/
+class LivePublisher
+{
+public:
+
+  LivePublisher(int numChannels, int unitsPerChannel, double samplingRate);
+  ~LivePublisher();
+
+  /// creates the segment, e.g. "/physio_psth", false on error
+  bool open(const char *name);
+
+  /// appends decoded scans
+  void publish(const double *scans, int nScans);
+
+  /// a spike in scan number scan
+  void publishEvent(uint64_t scan, int train);
+
+  /// scans published so far, the number the next one gets
+  uint64_t scans() const { return written; }
+
+private:
+
+  int nChannels;
+  int unitsPerChannel;
+  double rate;
+
+  // of the segment, to remove it again
+  char *name;
+  unsigned char *segment;
+  size_t segmentSize;
+
+  LiveHeader *header;
+  double *scanData;
+  LiveEvent *eventData;
+  uint32_t scanMask;
+  uint32_t eventMask;
+
+  uint64_t written;
+  uint64_t events;
+};
+
+#endif
@@ -0,0 +1,151 @@
+/***************************************************************************
+ *   Copyright (C) 2003 by Matthias H. Hennig                              *
+ *   hennig@cn.stir.ac.uk                                                  *
+ *   Copyright (C) 2005 by Bernd Porr                                      *
+ *   mail@berndporr.me.uk                                                  *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#include "livereader.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+LiveReader::LiveReader() :
+    segment(0),
+    segmentSize(0),
+    header(0),
+    scanPos(0),
+    eventPos(0),
+    scansLost(0),
+    eventsLost(0)
+{
+}
+
+LiveReader::~LiveReader()
+{
+  detach();
+}
+
+bool LiveReader::attach(const char *name)
+{
+  detach();
+
+  int fd = shm_open(name, O_RDONLY, 0);
+  if( fd < 0 )
+  {
+    perror(name);
+    return false;
+  }
+  struct stat st;
+  if( fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(LiveHeader) )
+  {
+    fprintf(stderr, "%s: no live data\n", name);
+    close(fd);
+    return false;
+  }
+  void *m = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if( m == MAP_FAILED )
+  {
+    perror("mmap");
+    return false;
+  }
+  segment = (const unsigned char *)m;
+  segmentSize = st.st_size;
+  header = (const LiveHeader *)segment;
+
+  // the magic is written last by the publisher
+  if( memcmp(header->magic, LIVE_MAGIC, sizeof(header->magic)) != 0 ||
+      header->version != LIVE_VERSION ||
+      header->segmentSize > segmentSize )
+  {
+    fprintf(stderr, "%s: not a physio_psth stream\n", name);
+    detach();
+    return false;
+  }
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+  skipToEnd();
+  scansLost = 0;
+  eventsLost = 0;
+  return true;
+}
+
+void LiveReader::detach()
+{
+  if( segment )
+    munmap((void *)segment, segmentSize);
+  segment = 0;
+  header = 0;
+}
+
+void LiveReader::skipToEnd()
+{
+  scanPos = liveLoad(&header->scansWritten);
+  eventPos = liveLoad(&header->eventsWritten);
+}
+
+int LiveReader::readRing(const unsigned char *ring, const uint64_t *counter,
+			 uint32_t capacity, size_t size, unsigned char *out,
+			 int max, uint64_t *pos, uint64_t *lost)
+{
+  // the publisher may be writing up to a quarter of the ring ahead
+  uint64_t safe = capacity - capacity / 4;
+
+  uint64_t written = liveLoad(counter);
+  if( written - *pos > safe )
+  {
+    *lost += written - safe - *pos;
+    *pos = written - safe;
+  }
+  int n = written - *pos < (uint64_t)max ? (int)(written - *pos) : max;
+
+  for(int i=0; i<n; )
+  {
+    uint32_t slot = (uint32_t)((*pos + i) % capacity);
+    int k = n - i;
+    if( k > (int)(capacity - slot) )
+      k = capacity - slot;
+    memcpy(out + i * size, ring + slot * size, k * size);
+    i += k;
+  }
+
+  // whatever the publisher got to meanwhile is no good, the copy has
+  // to be done before the counter is read again
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  written = liveLoad(counter);
+  int bad = 0;
+  if( written > *pos + safe )
+  {
+    uint64_t over = written - safe - *pos;
+    bad = over < (uint64_t)n ? (int)over : n;
+    memmove(out, out + bad * size, (n - bad) * size);
+    *lost += bad;
+  }
+  *pos += n;
+  return n - bad;
+}
+
+int LiveReader::readScans(double *scans, int maxScans)
+{
+  size_t size = header->numChannels * sizeof(double);
+  return readRing(segment + header->scanOffset, &header->scansWritten,
+		  header->scanCapacity, size, (unsigned char *)scans,
+		  maxScans, &scanPos, &scansLost);
+}
+
+int LiveReader::readEvents(LiveEvent *events, int maxEvents)
+{
+  return readRing(segment + header->eventOffset, &header->eventsWritten,
+		  header->eventCapacity, sizeof(LiveEvent),
+		  (unsigned char *)events, maxEvents, &eventPos, &eventsLost);
+}
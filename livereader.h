@@ -0,0 +1,75 @@
+/***************************************************************************
+ *   Copyright (C) 2003 by Matthias H. Hennig                              *
+ *   hennig@cn.stir.ac.uk                                                  *
+ *   Copyright (C) 2005 by Bernd Porr                                      *
+ *   mail@berndporr.me.uk                                                  *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#ifndef LIVEREADER_H
+#define LIVEREADER_H
+
+#include <stddef.h>
+
+#include "livestream.h"
+
+/**
+ * Reads the live data of a running physio_psth from another process.
+ * The segment is mapped read-only, the reader never writes to it and
+ * the publisher never waits for it. Reading starts with the data which
+ * arrives after attach(). Data which was overwritten before it could
+ * be read is skipped and counted in lostScans() and lostEvents().
+ * Only needs the C library, see livecat.cpp for an example.
+ **/
+class LiveReader
+{
+public:
+
+  LiveReader();
+  ~LiveReader();
+
+  /// maps the segment of the given name, false if there is none
+  bool attach(const char *name);
+  void detach();
+
+  int numChannels() const { return header->numChannels; }
+  int unitsPerChannel() const { return header->unitsPerChannel; }
+  double samplingRate() const { return header->samplingRate; }
+
+  /// copies up to maxScans new scans of numChannels() volts to scans
+  /// and returns how many, 0 if there are none
+  int readScans(double *scans, int maxScans);
+  /// up to maxEvents new spikes
+  int readEvents(LiveEvent *events, int maxEvents);
+
+  /// number of the scan readScans() returns next
+  uint64_t nextScan() const { return scanPos; }
+  /// skips everything not read yet, e.g. when only the latest matters
+  void skipToEnd();
+
+  uint64_t lostScans() const { return scansLost; }
+  uint64_t lostEvents() const { return eventsLost; }
+
+private:
+
+  // copies up to max records of size bytes from a ring of capacity
+  // records, returns how many are good and moves pos on
+  int readRing(const unsigned char *ring, const uint64_t *counter,
+	       uint32_t capacity, size_t size, unsigned char *out, int max,
+	       uint64_t *pos, uint64_t *lost);
+
+  const unsigned char *segment;
+  size_t segmentSize;
+  const LiveHeader *header;
+
+  uint64_t scanPos;
+  uint64_t eventPos;
+  uint64_t scansLost;
+  uint64_t eventsLost;
+};
+
+#endif
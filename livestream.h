@@ -0,0 +1,84 @@
+/***************************************************************************
+ *   Copyright (C) 2003 by Matthias H. Hennig                              *
+ *   hennig@cn.stir.ac.uk                                                  *
+ *   Copyright (C) 2005 by Bernd Porr                                      *
+ *   mail@berndporr.me.uk                                                  *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#ifndef LIVESTREAM_H
+#define LIVESTREAM_H
+
+#include <stdint.h>
+
+/*
+ * Layout of the shared memory segment with the live data (see
+ * LivePublisher and LiveReader), in the byte order of this machine:
+ *
+ *   LiveHeader
+ *   scanCapacity scans of numChannels doubles    (at scanOffset)
+ *   eventCapacity LiveEvents                     (at eventOffset)
+ *
+ * Both are rings: scan number s (counting from 0 when the publisher
+ * started) is at s % scanCapacity, event e at e % eventCapacity. The
+ * publisher fills in the data first and then raises scansWritten or
+ * eventsWritten, so everything below these counters is complete. It
+ * never writes more than a quarter of a ring ahead of its counter: a
+ * reader which has copied scan s is fine if scansWritten is still at
+ * most s + 3/4 scanCapacity afterwards, otherwise the scan may have
+ * been overwritten meanwhile. The same goes for the events.
+ *
+ * The samples are in volts, as decoded from the device and before any
+ * filtering. Events are spikes: trains below numChannels are the
+ * spikes detected on that channel, train numChannels + c *
+ * unitsPerChannel + u those sorted into unit u of channel c.
+ */
+
+#define LIVE_MAGIC "PSTHLIV1"
+#define LIVE_VERSION 1
+
+struct LiveHeader
+{
+  char magic[8];
+  uint32_t version;
+  // sizeof(LiveHeader) of the publisher
+  uint32_t headerSize;
+  uint32_t numChannels;
+  uint32_t unitsPerChannel;
+  double samplingRate;
+  // both powers of two
+  uint32_t scanCapacity;
+  uint32_t eventCapacity;
+  // from the start of the segment, in bytes
+  uint64_t scanOffset;
+  uint64_t eventOffset;
+  uint64_t segmentSize;
+  // only ever grow, read and written with liveLoad() and liveStore()
+  uint64_t scansWritten;
+  uint64_t eventsWritten;
+};
+
+struct LiveEvent
+{
+  // number of the scan with the spike
+  uint64_t scan;
+  uint32_t train;
+  uint32_t reserved;
+};
+
+// the counters are shared between processes, so these are not Qt's
+inline uint64_t liveLoad(const uint64_t *counter)
+{
+  return __atomic_load_n(counter, __ATOMIC_ACQUIRE);
+}
+
+inline void liveStore(uint64_t *counter, uint64_t value)
+{
+  __atomic_store_n(counter, value, __ATOMIC_RELEASE);
+}
+
+#endif
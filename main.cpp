@@ -10,14 +10,224 @@
 
 #include "physio_psth.h"
 
+#include "comedisource.h"
+#include "multisource.h"
+#include "filesource.h"
+#include "syntheticsource.h"
+#include "batch.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <string.h>
+
 #include <QApplication>
+#include <QCoreApplication>
+#include <QByteArray>
+#include <QStringList>
+
+// the value following name on the command line
+static QString option(const QStringList &args, const char *name,
+		      const QString &def)
+{
+  int i = args.indexOf(name);
+  if( i < 0 || i + 1 >= args.size() )
+    return def;
+  return args.at(i + 1);
+}
+
+// analyses recordings without a GUI:
+// --batch [--length ms] [--binwidth ms] [--threshold V] [--filter]
+//         [--notch Hz] [--vep] [--trigger channel] [--trigger-level V]
+//         [--pretrigger ms] [--templates file]
+//         [--smooth gaussian|exponential] [--kernel ms] [--out dir]
+//         [--npz] [--jobs n] recording...
+static int batchMain(int argc, char **argv)
+{
+  QCoreApplication app(argc, argv);
+  QStringList args = app.arguments();
+
+  BatchSettings settings;
+  settings.psthLength = option(args, "--length", "1000").toInt();
+  settings.psthBinw = option(args, "--binwidth", "20").toInt();
+  settings.spikeThres = option(args, "--threshold", "1").toDouble();
+  settings.filter = args.contains("--filter");
+  settings.notchFrequency = option(args, "--notch", QString::number(NOTCH_F)).toDouble();
+  settings.average = args.contains("--vep");
+  settings.triggerChannel = option(args, "--trigger", "-1").toInt();
+  settings.triggerLevel = option(args, "--trigger-level", QString::number(TRIGGER_LEVEL)).toDouble();
+  settings.preTrigger = option(args, "--pretrigger", "0").toInt();
+  settings.templates = option(args, "--templates", "");
+  QString smooth = option(args, "--smooth", "none");
+  if( smooth == "gaussian" )
+    settings.kernel = KERNEL_GAUSSIAN;
+  else if( smooth == "exponential" )
+    settings.kernel = KERNEL_EXPONENTIAL;
+  settings.kernelWidth = option(args, "--kernel", "10").toDouble();
+  settings.outDir = option(args, "--out", "");
+  settings.npz = args.contains("--npz");
+  settings.jobs = option(args, "--jobs", "0").toInt();
+
+  if( settings.psthLength < 1 || settings.psthBinw < 1 ||
+      settings.preTrigger < 0 )
+  {
+    fprintf(stderr, "invalid sweep length or bin width\n");
+    return 1;
+  }
+  if( settings.kernel != KERNEL_NONE && settings.kernelWidth <= 0 )
+  {
+    fprintf(stderr, "invalid kernel width\n");
+    return 1;
+  }
+
+  // everything that is neither an option nor its value is a recording
+  QStringList valueOptions;
+  valueOptions << "--length" << "--binwidth" << "--threshold"
+	       << "--notch" << "--trigger" << "--trigger-level"
+	       << "--pretrigger" << "--templates" << "--smooth" << "--kernel"
+	       << "--out" << "--jobs";
+  QStringList files;
+  for(int i=1; i<args.size(); i++)
+  {
+    if( valueOptions.contains(args.at(i)) )
+      i++;
+    else if( !args.at(i).startsWith("--") )
+      files << args.at(i);
+  }
+
+  if( files.isEmpty() )
+  {
+    fprintf(stderr, "no recordings given\n");
+    return 1;
+  }
+
+  return runBatch(files, settings) ? 1 : 0;
+}
+
+// a comma separated list of numbers following name on the command line
+static QList<double> listOption(const QStringList &args, const char *name,
+				const QString &def)
+{
+  QList<double> list;
+  QStringList items = option(args, name, def).split(',');
+  for(int i=0; i<items.size(); i++)
+    list << items.at(i).toDouble();
+  return list;
+}
+
+// times the analysis stages on synthetic data:
+// --bench [--channels n,...] [--rates Hz,...] [--lengths ms,...]
+//         [--seconds s] [--no-plot]
+static int benchMain(int argc, char **argv)
+{
+  bool plot = true;
+  for(int i=1; i<argc; i++)
+    if( strcmp(argv[i], "--no-plot") == 0 )
+      plot = false;
+
+  // the raw data plot is a widget, everything else works without
+  QCoreApplication *app;
+  if( plot )
+    app = new QApplication(argc, argv);
+  else
+    app = new QCoreApplication(argc, argv);
+  QStringList args = app->arguments();
+
+  BenchSettings settings;
+  QList<double> channels = listOption(args, "--channels", "1,4,16");
+  for(int i=0; i<channels.size(); i++)
+    settings.channels << (int)channels.at(i);
+  settings.rates = listOption(args, "--rates", "1000,20000");
+  QList<double> lengths = listOption(args, "--lengths", "1000,10000");
+  for(int i=0; i<lengths.size(); i++)
+    settings.lengths << (int)lengths.at(i);
+  settings.seconds = option(args, "--seconds", "2").toDouble();
+  settings.plot = plot;
+
+  runBench(settings);
+
+  delete app;
+  return 0;
+}
 
 int main(int argc, char **argv)
 {
+  for(int i=1; i<argc; i++)
+  {
+    if( strcmp(argv[i], "--batch") == 0 )
+      return batchMain(argc, argv);
+    if( strcmp(argv[i], "--bench") == 0 )
+      return benchMain(argc, argv);
+  }
+
   QApplication app(argc, argv);
-  MainWindow   mainWindow;
+
+  QStringList args = app.arguments();
+  SampleSource *source;
+  // the comedi sources keep pointers to their file names
+  QList<QByteArray> deviceNames;
+
+  if( args.contains("--file") )
+  {
+    // replay a recording, "--fast" drops the real time pacing
+    QString name = option(args, "--file", "");
+    source = new FileSource(name.toLocal8Bit().constData(),
+			    !args.contains("--fast"));
+  }
+  else if( args.contains("--synthetic") )
+  {
+    // Poisson spike trains plus noise, no hardware needed
+    int channels = option(args, "--channels", "4").toInt();
+    double rate = option(args, "--rate", QString::number(SAMPLING_RATE)).toDouble();
+    double spikeRate = option(args, "--spikerate", "20").toDouble();
+    source = new SyntheticSource(channels, rate, spikeRate,
+				 !args.contains("--fast"));
+  }
+  else
+  {
+    // "--mmap" decodes the data straight from the mapped comedi buffer
+    ComediSource::Backend backend = ComediSource::ReadBackend;
+    if( args.contains("--mmap") )
+      backend = ComediSource::MmapBackend;
+    double rate = option(args, "--rate", QString::number(SAMPLING_RATE)).toDouble();
+    if( args.contains("--devices") )
+    {
+      // several boards, each read on its own thread and merged into
+      // one set of channels in the order given
+      QStringList names = option(args, "--devices", "").split(',');
+      SampleSource **devices = new SampleSource*[names.size()];
+      for(int i=0; i<names.size(); i++)
+      {
+	deviceNames << names.at(i).toLocal8Bit();
+	devices[i] = new ComediSource(deviceNames.last().constData(), rate, backend);
+      }
+      source = new MultiSource(devices, names.size());
+      delete[] devices;
+    }
+    else
+      source = new ComediSource("/dev/comedi0", rate, backend);
+  }
+
+  MainWindow   mainWindow(source);
+
+  // "--fps n" limits the replots, e.g. on slow laptops
+  if( args.contains("--fps") )
+    mainWindow.setFrameRate(option(args, "--fps", "0").toDouble());
+
+  // "--templates file" sorts the spikes into units from the start
+  if( args.contains("--templates") )
+    mainWindow.loadTemplates(option(args, "--templates", "").toLocal8Bit().constData());
+
+  // "--publish name" shares the live data with other processes
+  if( args.contains("--publish") )
+    mainWindow.publish(option(args, "--publish", "/physio_psth").toLocal8Bit().constData());
 
   mainWindow.show();
   
-  return app.exec();
+  int ret = app.exec();
+
+  // "--stats file" dumps the pipeline timings at exit
+  if( args.contains("--stats") )
+    mainWindow.saveStats(option(args, "--stats", "stats.json").toLocal8Bit().constData());
+
+  return ret;
 }
@@ -0,0 +1,360 @@
+/***************************************************************************
+ *   Copyright (C) 2003 by Matthias H. Hennig                              *
+ *   hennig@cn.stir.ac.uk                                                  *
+ *   Copyright (C) 2005 by Bernd Porr                                      *
+ *   mail@berndporr.me.uk                                                  *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#include "multisource.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+// room for the samples of one merged block plus what is left over
+#define STAGING_SCANS (2 * MULTI_BLOCK_SCANS + 2)
+
+DeviceReader::DeviceReader(SampleSource *source, SampleRing *ring) :
+    source(source),
+    ring(ring),
+    running(0),
+    error(0),
+    end(0)
+{
+  codes = new double[MULTI_BLOCK_SCANS * source->numChannels()];
+}
+
+DeviceReader::~DeviceReader()
+{
+  stop();
+  wait();
+  delete[] codes;
+}
+
+void DeviceReader::run()
+{
+  while( running.loadAcquire() )
+  {
+    const void *raw;
+    int nScans = source->acquire(&raw, MULTI_BLOCK_SCANS);
+    if( nScans < 0 )
+    {
+      if( source->atEnd() )
+	end.storeRelease(1);
+      else
+	error.storeRelease(1);
+      break;
+    }
+    if( nScans == 0 )
+      continue;
+
+    int n = nScans * source->numChannels();
+    if( source->isLsampl() )
+    {
+      const lsampl_t *s = (const lsampl_t *)raw;
+      for(int i=0; i<n; i++)
+	codes[i] = s[i];
+    }
+    else
+    {
+      const sampl_t *s = (const sampl_t *)raw;
+      for(int i=0; i<n; i++)
+	codes[i] = s[i];
+    }
+    source->release(nScans);
+    ring->push(codes, nScans);
+  }
+}
+
+MultiSource::MultiSource(SampleSource **devices, int numDevices) :
+    nDevices(numDevices),
+    merged(0),
+    aligned(false),
+    ended(false),
+    block(0),
+    bufSize(0)
+{
+  sources = new SampleSource*[nDevices];
+  firstChannel = new int[nDevices];
+  rings = new SampleRing*[nDevices];
+  readers = new DeviceReader*[nDevices];
+  lost = new int[nDevices];
+  staging = new double*[nDevices];
+  have = new int[nDevices];
+  pos = new double[nDevices];
+  step = new double[nDevices];
+  ratio = new double[nDevices];
+  arrived = new long int[nDevices];
+  start = new long int[nDevices];
+
+  for(int d=0; d<nDevices; d++)
+  {
+    sources[d] = devices[d];
+    rings[d] = 0;
+    readers[d] = 0;
+    staging[d] = 0;
+    have[d] = 0;
+    pos[d] = 0;
+    step[d] = 1;
+    ratio[d] = 1;
+    arrived[d] = 0;
+    start[d] = 0;
+    lost[d] = 0;
+  }
+}
+
+MultiSource::~MultiSource()
+{
+  // stop them all first, they do not depend on each other
+  for(int d=0; d<nDevices; d++)
+    if( readers[d] )
+      readers[d]->stop();
+
+  for(int d=0; d<nDevices; d++)
+  {
+    if( d > 0 && readers[d] )
+      fprintf(stderr, "device %d: clock %+.1f ppm\n", d, drift(d));
+    delete readers[d];
+    delete rings[d];
+    delete[] staging[d];
+    delete sources[d];
+  }
+  delete[] sources;
+  delete[] firstChannel;
+  delete[] rings;
+  delete[] readers;
+  delete[] lost;
+  delete[] staging;
+  delete[] have;
+  delete[] pos;
+  delete[] step;
+  delete[] ratio;
+  delete[] arrived;
+  delete[] start;
+  delete[] block;
+}
+
+int MultiSource::open()
+{
+  for(int d=0; d<nDevices; d++)
+    if( sources[d]->open() < 0 )
+      return -1;
+
+  SampleSource *first = sources[0];
+  rate = first->samplingRate();
+  maxdata = first->maxData();
+  crange = *first->range();
+  lsampl = true;
+
+  nChannels = 0;
+  for(int d=0; d<nDevices; d++)
+  {
+    SampleSource *s = sources[d];
+    // the values are converted with the first device's range
+    if( s->maxData() != maxdata ||
+	s->range()->min != crange.min || s->range()->max != crange.max )
+    {
+      fprintf(stderr, "device %d has another range than device 0\n", d);
+      return -1;
+    }
+    // only small clock differences are resampled
+    if( s->samplingRate() < rate * 0.99 || s->samplingRate() > rate * 1.01 )
+    {
+      fprintf(stderr, "device %d samples at %g Hz, device 0 at %g Hz\n",
+	      d, s->samplingRate(), rate);
+      return -1;
+    }
+    firstChannel[d] = nChannels;
+    nChannels += s->numChannels();
+    if( s->bufferSize() > bufSize )
+      bufSize = s->bufferSize();
+  }
+
+  block = new lsampl_t[MULTI_BLOCK_SCANS * nChannels];
+
+  for(int d=0; d<nDevices; d++)
+  {
+    int n = sources[d]->numChannels();
+    rings[d] = new SampleRing(n, (int)(rate * MULTI_RING_SECONDS));
+    staging[d] = new double[STAGING_SCANS * n];
+    readers[d] = new DeviceReader(sources[d], rings[d]);
+  }
+  for(int d=0; d<nDevices; d++)
+    readers[d]->start();
+
+  return 0;
+}
+
+void MultiSource::fill()
+{
+  for(int d=0; d<nDevices; d++)
+  {
+    int nc = sources[d]->numChannels();
+    double *s = staging[d];
+
+    // drop the samples which have been passed
+    int used = (int)pos[d];
+    if( used > have[d] )
+      used = have[d];
+    memmove(s, s + used * nc, (have[d] - used) * nc * sizeof(double));
+    have[d] -= used;
+    pos[d] -= used;
+
+    const double *y;
+    int n;
+    while( have[d] < STAGING_SCANS && (n = rings[d]->peek(&y)) > 0 )
+    {
+      if( n > STAGING_SCANS - have[d] )
+	n = STAGING_SCANS - have[d];
+      memcpy(s + have[d] * nc, y, n * nc * sizeof(double));
+      rings[d]->consume(n);
+      have[d] += n;
+      arrived[d] += n;
+    }
+  }
+}
+
+bool MultiSource::align()
+{
+  for(int d=0; d<nDevices; d++)
+    if( have[d] == 0 )
+      return false;
+
+  long int *backlog = new long int[nDevices];
+  long int least = -1;
+  for(int d=0; d<nDevices; d++)
+  {
+    backlog[d] = have[d] + rings[d]->readAvailable();
+    if( least < 0 || backlog[d] < least )
+      least = backlog[d];
+  }
+
+  // the devices were started one after the other, the samples which
+  // arrived at the same time belong together
+  for(int d=0; d<nDevices; d++)
+  {
+    pos[d] = backlog[d] - least;
+    step[d] = 1;
+    start[d] = arrived[d] - have[d] + backlog[d] - least;
+    lost[d] = rings[d]->overruns();
+  }
+  merged = 0;
+
+  delete[] backlog;
+  return true;
+}
+
+void MultiSource::track()
+{
+  double horizon = rate * DRIFT_MIN_SECONDS;
+  long int ref = arrived[0] + rings[0]->readAvailable() - start[0];
+
+  for(int d=1; d<nDevices; d++)
+  {
+    // the jitter of the arrivals averages out over time
+    long int got = arrived[d] + rings[d]->readAvailable() - start[d];
+    if( ref >= horizon )
+      ratio[d] = (double)got / ref;
+
+    // head for where the ratio puts this device a second from now,
+    // so that a new ratio never makes the data jump
+    double now = arrived[d] - have[d] + pos[d];
+    step[d] = (start[d] + (merged + horizon) * ratio[d] - now) / horizon;
+  }
+}
+
+int MultiSource::merge(int maxScans)
+{
+  int n = 0;
+  while( n < maxScans )
+  {
+    // interpolation needs the sample after the position as well
+    int d;
+    for(d=0; d<nDevices; d++)
+      if( (int)pos[d] + 1 >= have[d] )
+	break;
+    if( d < nDevices )
+      break;
+
+    lsampl_t *scan = block + n * nChannels;
+    for(d=0; d<nDevices; d++)
+    {
+      int nc = sources[d]->numChannels();
+      int i = (int)pos[d];
+      double f = pos[d] - i;
+      const double *a = staging[d] + i * nc;
+      const double *b = a + nc;
+      lsampl_t *out = scan + firstChannel[d];
+      for(int c=0; c<nc; c++)
+	out[c] = (lsampl_t)(a[c] + f * (b[c] - a[c]) + 0.5);
+      pos[d] += step[d];
+    }
+    n++;
+  }
+  return n;
+}
+
+int MultiSource::acquire(const void **data, int maxScans)
+{
+  if( maxScans > MULTI_BLOCK_SCANS )
+    maxScans = MULTI_BLOCK_SCANS;
+
+  for(int t=0; ; t++)
+  {
+    for(int d=0; d<nDevices; d++)
+    {
+      if( readers[d]->atEnd() )
+	ended = true;
+      if( readers[d]->failed() || readers[d]->atEnd() )
+	return -1;
+      // samples were lost, the old alignment is no good any more
+      if( rings[d]->overruns() != lost[d] )
+	aligned = false;
+    }
+
+    fill();
+    if( !aligned )
+      aligned = align();
+    if( aligned )
+    {
+      int n = merge(maxScans);
+      if( n > 0 )
+      {
+	merged += n;
+	track();
+	*data = block;
+	return n;
+      }
+    }
+
+    if( t >= ACQ_POLL_TIMEOUT )
+      return 0;
+    usleep(1000);
+  }
+}
+
+void MultiSource::release(int)
+{
+  // the block is filled again by the next acquire()
+}
+
+int MultiSource::bufferContents()
+{
+  int fullest = -1;
+  for(int d=0; d<nDevices; d++)
+  {
+    int size = sources[d]->bufferSize();
+    int bytes = sources[d]->bufferContents();
+    if( size <= 0 || bytes < 0 )
+      continue;
+    int level = (int)((double)bytes / size * bufSize);
+    if( level > fullest )
+      fullest = level;
+  }
+  return fullest;
+}
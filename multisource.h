@@ -0,0 +1,143 @@
+/***************************************************************************
+ *   Copyright (C) 2003 by Matthias H. Hennig                              *
+ *   hennig@cn.stir.ac.uk                                                  *
+ *   Copyright (C) 2005 by Bernd Porr                                      *
+ *   mail@berndporr.me.uk                                                  *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#ifndef MULTISOURCE_H
+#define MULTISOURCE_H
+
+#include <QThread>
+#include <QAtomicInt>
+
+#include "samplesource.h"
+#include "samplering.h"
+
+// scans handed out by one acquire() at most
+#define MULTI_BLOCK_SCANS 4096
+// seconds of samples each device can be ahead of the slowest one
+#define MULTI_RING_SECONDS 2
+// seconds of data before the clock ratios are trusted
+#define DRIFT_MIN_SECONDS 1
+
+/**
+ * Reads one device on its own thread and pushes its samples, still as
+ * raw comedi values, into a ring.
+ **/
+class DeviceReader : public QThread
+{
+public:
+
+  // the source has to be open() already
+  DeviceReader(SampleSource *source, SampleRing *ring);
+  ~DeviceReader();
+
+  // the flag is set here, so that stop() works before run() does
+  void start()
+  {
+    running.storeRelease(1);
+    QThread::start();
+  }
+  void stop() { running.storeRelease(0); }
+  bool failed() const { return error.loadAcquire() != 0; }
+  bool atEnd() const { return end.loadAcquire() != 0; }
+
+protected:
+
+  virtual void run();
+
+private:
+
+  SampleSource *source;
+  SampleRing *ring;
+  // one block of raw values
+  double *codes;
+
+  QAtomicInt running;
+  QAtomicInt error;
+  QAtomicInt end;
+};
+
+/**
+ * Several devices as one source: the channels of the first device come
+ * first, then those of the second and so on. Every device is read by
+ * its own DeviceReader, so the throughput grows with the number of
+ * boards. The first device is the clock of the merged stream. The
+ * others are aligned to it when the data starts to flow and then
+ * resampled (linear interpolation) at the ratio of their clock to the
+ * first one's, which is worked out from the number of samples each has
+ * delivered since. The devices need the same range and maxdata, the
+ * merged scans are lsampl_t.
+ **/
+class MultiSource : public SampleSource
+{
+public:
+
+  // takes over the sources, which must not be open yet
+  MultiSource(SampleSource **sources, int numDevices);
+  ~MultiSource();
+
+  virtual int open();
+  virtual int acquire(const void **data, int maxScans);
+  virtual void release(int nScans);
+  virtual bool atEnd() const { return ended; }
+  // of the fullest device buffer
+  virtual int bufferContents();
+  virtual int bufferSize() const { return bufSize; }
+
+  int numDevices() const { return nDevices; }
+  /// how much faster the clock of device d runs than the first one's,
+  /// in ppm
+  double drift(int d) const { return (ratio[d] - 1) * 1e6; }
+
+private:
+
+  // moves the new samples of each device from its ring to its staging
+  // buffer and drops those already used
+  void fill();
+  // drops the samples of the devices which started early, so all
+  // have the same backlog, false if a device has not delivered yet
+  bool align();
+  // merges as many scans as all devices have, up to maxScans
+  int merge(int maxScans);
+  // new steps from the ratio of the samples delivered since align()
+  void track();
+
+  SampleSource **sources;
+  int nDevices;
+  // channel of the merged scan where each device starts
+  int *firstChannel;
+
+  SampleRing **rings;
+  DeviceReader **readers;
+  // overruns of each ring at the last align()
+  int *lost;
+
+  // samples taken from the ring, starting at position 0
+  double **staging;
+  int *have;
+  // read position in the staging buffer and its step per merged scan
+  double *pos;
+  double *step;
+  // clock of each device relative to the first one
+  double *ratio;
+
+  // samples taken from each ring in total, the number of the sample
+  // merged first after the last align() and the scans merged since
+  long int *arrived;
+  long int *start;
+  long int merged;
+  bool aligned;
+  bool ended;
+
+  lsampl_t *block;
+  int bufSize;
+};
+
+#endif
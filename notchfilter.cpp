@@ -0,0 +1,221 @@
+/***************************************************************************
+ *   Copyright (C) 2003 by Matthias H. Hennig                              *
+ *   hennig@cn.stir.ac.uk                                                  *
+ *   Copyright (C) 2005 by Bernd Porr                                      *
+ *   mail@berndporr.me.uk                                                  *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#include "notchfilter.h"
+
+#include <string.h>
+
+#include <Iir.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+NotchFilterBank::NotchFilterBank(int numChannels, double samplingRate) :
+    nChannels(numChannels),
+    samplingRate(samplingRate),
+    centre(0),
+    nStages(0)
+{
+  s1 = new double[NOTCH_MAX_STAGES * nChannels];
+  s2 = new double[NOTCH_MAX_STAGES * nChannels];
+  setFrequency(NOTCH_F);
+}
+
+NotchFilterBank::~NotchFilterBank()
+{
+  delete[] s1;
+  delete[] s2;
+}
+
+void NotchFilterBank::setFrequency(double f)
+{
+  Iir::Butterworth::BandStop<IIRORDER> design;
+  design.setup(IIRORDER, samplingRate, f, f/10.0);
+
+  nStages = design.getNumStages();
+  if( nStages > NOTCH_MAX_STAGES )
+    nStages = NOTCH_MAX_STAGES;
+
+  for(int s=0; s<nStages; s++)
+  {
+    const Iir::Biquad &bq = design[s];
+    double a0 = bq.getA0();
+    b0[s] = bq.getB0() / a0;
+    b1[s] = bq.getB1() / a0;
+    b2[s] = bq.getB2() / a0;
+    a1[s] = bq.getA1() / a0;
+    a2[s] = bq.getA2() / a0;
+  }
+
+  centre = f;
+  reset();
+}
+
+void NotchFilterBank::reset()
+{
+  memset(s1, 0, NOTCH_MAX_STAGES * nChannels * sizeof(double));
+  memset(s2, 0, NOTCH_MAX_STAGES * nChannels * sizeof(double));
+}
+
+void NotchFilterBank::processScalar(const double *in, double *out,
+				    int nScans, int first, int last)
+{
+  for(int c=first; c<last; c++)
+  {
+    for(int n=0; n<nScans; n++)
+    {
+      double x = in[n*nChannels + c];
+
+      for(int s=0; s<nStages; s++)
+      {
+        double *z1 = s1 + s*nChannels + c;
+        double *z2 = s2 + s*nChannels + c;
+        double y = b0[s]*x + *z1;
+        *z1 = b1[s]*x - a1[s]*y + *z2;
+        *z2 = b2[s]*x - a2[s]*y;
+        x = y;
+      }
+
+      out[n*nChannels + c] = x;
+    }
+  }
+}
+
+#ifdef HAVE_X86_SIMD
+
+// four channels at a time, the state stays in registers for the block
+__attribute__((target("avx")))
+static int processAvx(const double *in, double *out, int nScans,
+		      int nChannels, int nStages,
+		      const double *b0, const double *b1, const double *b2,
+		      const double *a1, const double *a2,
+		      double *s1, double *s2)
+{
+  int c = 0;
+
+  for(; c+4<=nChannels; c+=4)
+  {
+    __m256d z1[NOTCH_MAX_STAGES], z2[NOTCH_MAX_STAGES];
+    for(int s=0; s<nStages; s++)
+    {
+      z1[s] = _mm256_loadu_pd(s1 + s*nChannels + c);
+      z2[s] = _mm256_loadu_pd(s2 + s*nChannels + c);
+    }
+
+    for(int n=0; n<nScans; n++)
+    {
+      __m256d x = _mm256_loadu_pd(in + n*nChannels + c);
+
+      for(int s=0; s<nStages; s++)
+      {
+        __m256d y = _mm256_add_pd(_mm256_mul_pd(_mm256_set1_pd(b0[s]), x), z1[s]);
+        z1[s] = _mm256_add_pd(_mm256_sub_pd(_mm256_mul_pd(_mm256_set1_pd(b1[s]), x),
+					    _mm256_mul_pd(_mm256_set1_pd(a1[s]), y)),
+			      z2[s]);
+        z2[s] = _mm256_sub_pd(_mm256_mul_pd(_mm256_set1_pd(b2[s]), x),
+			      _mm256_mul_pd(_mm256_set1_pd(a2[s]), y));
+        x = y;
+      }
+
+      _mm256_storeu_pd(out + n*nChannels + c, x);
+    }
+
+    for(int s=0; s<nStages; s++)
+    {
+      _mm256_storeu_pd(s1 + s*nChannels + c, z1[s]);
+      _mm256_storeu_pd(s2 + s*nChannels + c, z2[s]);
+    }
+  }
+
+  return c;
+}
+
+// the same with two channels per register
+__attribute__((target("sse2")))
+static int processSse2(const double *in, double *out, int nScans,
+		       int nChannels, int nStages,
+		       const double *b0, const double *b1, const double *b2,
+		       const double *a1, const double *a2,
+		       double *s1, double *s2)
+{
+  int c = 0;
+
+  for(; c+2<=nChannels; c+=2)
+  {
+    __m128d z1[NOTCH_MAX_STAGES], z2[NOTCH_MAX_STAGES];
+    for(int s=0; s<nStages; s++)
+    {
+      z1[s] = _mm_loadu_pd(s1 + s*nChannels + c);
+      z2[s] = _mm_loadu_pd(s2 + s*nChannels + c);
+    }
+
+    for(int n=0; n<nScans; n++)
+    {
+      __m128d x = _mm_loadu_pd(in + n*nChannels + c);
+
+      for(int s=0; s<nStages; s++)
+      {
+        __m128d y = _mm_add_pd(_mm_mul_pd(_mm_set1_pd(b0[s]), x), z1[s]);
+        z1[s] = _mm_add_pd(_mm_sub_pd(_mm_mul_pd(_mm_set1_pd(b1[s]), x),
+				      _mm_mul_pd(_mm_set1_pd(a1[s]), y)),
+			   z2[s]);
+        z2[s] = _mm_sub_pd(_mm_mul_pd(_mm_set1_pd(b2[s]), x),
+			   _mm_mul_pd(_mm_set1_pd(a2[s]), y));
+        x = y;
+      }
+
+      _mm_storeu_pd(out + n*nChannels + c, x);
+    }
+
+    for(int s=0; s<nStages; s++)
+    {
+      _mm_storeu_pd(s1 + s*nChannels + c, z1[s]);
+      _mm_storeu_pd(s2 + s*nChannels + c, z2[s]);
+    }
+  }
+
+  return c;
+}
+
+typedef int (*BankFunction)(const double *, double *, int, int, int,
+			    const double *, const double *, const double *,
+			    const double *, const double *, double *, double *);
+
+static BankFunction selectBank()
+{
+  __builtin_cpu_init();
+  if( __builtin_cpu_supports("avx") )
+    return processAvx;
+  if( __builtin_cpu_supports("sse2") )
+    return processSse2;
+  return 0;
+}
+
+static const BankFunction bank = selectBank();
+
+#endif
+
+void NotchFilterBank::process(const double *in, double *out, int nScans)
+{
+  int done = 0;
+
+#ifdef HAVE_X86_SIMD
+  if( bank )
+    done = bank(in, out, nScans, nChannels, nStages,
+		b0, b1, b2, a1, a2, s1, s2);
+#endif
+
+  // the channels left over
+  processScalar(in, out, nScans, done, nChannels);
+}
@@ -0,0 +1,63 @@
+/***************************************************************************
+ *   Copyright (C) 2003 by Matthias H. Hennig                              *
+ *   hennig@cn.stir.ac.uk                                                  *
+ *   Copyright (C) 2005 by Bernd Porr                                      *
+ *   mail@berndporr.me.uk                                                  *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#ifndef NOTCHFILTER_H
+#define NOTCHFILTER_H
+
+#define NOTCH_F 50 // filter out 50Hz noise
+#define IIRORDER 6
+
+// a bandstop of order IIRORDER has that many biquads
+#define NOTCH_MAX_STAGES IIRORDER
+
+/**
+ * Mains notch for all channels at once. The Butterworth bandstop is
+ * designed with the Iir library and run here as a cascade of biquads
+ * (transposed direct form II) over interleaved scans, so the channels
+ * of one scan are the SIMD lanes. Every channel has its own state.
+ **/
+class NotchFilterBank
+{
+public:
+
+  NotchFilterBank(int numChannels, double samplingRate);
+  ~NotchFilterBank();
+
+  /// centre frequency in Hz (50 or 60), clears the state
+  void setFrequency(double f);
+  double frequency() const { return centre; }
+
+  void reset();
+
+  /// filters nScans interleaved scans, in and out may be the same
+  void process(const double *in, double *out, int nScans);
+
+private:
+
+  void processScalar(const double *in, double *out, int nScans,
+		     int first, int last);
+
+  int nChannels;
+  double samplingRate;
+  double centre;
+
+  int nStages;
+  // per stage, normalised to a0 = 1
+  double b0[NOTCH_MAX_STAGES], b1[NOTCH_MAX_STAGES], b2[NOTCH_MAX_STAGES];
+  double a1[NOTCH_MAX_STAGES], a2[NOTCH_MAX_STAGES];
+
+  // per stage: one state value per channel
+  double *s1;
+  double *s2;
+};
+
+#endif
@@ -0,0 +1,257 @@
+/***************************************************************************
+ *   Copyright (C) 2003 by Matthias H. Hennig                              *
+ *   hennig@cn.stir.ac.uk                                                  *
+ *   Copyright (C) 2005 by Bernd Porr                                      *
+ *   mail@berndporr.me.uk                                                  *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#include "npzwriter.h"
+
+#include <string.h>
+
+// the zip crc32, polynomial 0xedb88320
+struct CrcTable
+{
+  uint32_t t[256];
+
+  CrcTable()
+  {
+    for(uint32_t i=0; i<256; i++)
+    {
+      uint32_t c = i;
+      for(int k=0; k<8; k++)
+	c = c & 1 ? 0xedb88320 ^ (c >> 1) : c >> 1;
+      t[i] = c;
+    }
+  }
+};
+
+static uint32_t updateCrc(uint32_t crc, const unsigned char *p, size_t n)
+{
+  // built by the first caller, also with several exports at once
+  static const CrcTable table;
+  crc = ~crc;
+  for(size_t i=0; i<n; i++)
+    crc = table.t[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+  return ~crc;
+}
+
+// zip is little endian
+static void put16(unsigned char *p, uint32_t v)
+{
+  p[0] = v & 0xff;
+  p[1] = (v >> 8) & 0xff;
+}
+
+static void put32(unsigned char *p, uint32_t v)
+{
+  put16(p, v & 0xffff);
+  put16(p + 2, v >> 16);
+}
+
+NpzWriter::NpzWriter() :
+    f(0),
+    buffer(0),
+    ok(false),
+    nMembers(0),
+    crc(0),
+    size(0)
+{
+}
+
+NpzWriter::~NpzWriter()
+{
+  if( f )
+    fclose(f);
+  delete[] buffer;
+}
+
+bool NpzWriter::open(const char *filename)
+{
+  f = fopen(filename, "wb");
+  if( !f )
+  {
+    perror(filename);
+    return false;
+  }
+  buffer = new char[NPZ_BUFFER_BYTES];
+  setvbuf(f, buffer, _IOFBF, NPZ_BUFFER_BYTES);
+  nMembers = 0;
+  ok = true;
+  return true;
+}
+
+bool NpzWriter::writeLocalHeader(const Member *m)
+{
+  size_t nameLength = strlen(m->name);
+  unsigned char h[30];
+  put32(h, 0x04034b50);
+  put16(h + 4, 20);		// version needed
+  put16(h + 6, 0);		// flags
+  put16(h + 8, 0);		// stored
+  put16(h + 10, 0);		// time
+  put16(h + 12, 0x21);		// 1980-01-01
+  put32(h + 14, m->crc);
+  put32(h + 18, m->size);	// compressed
+  put32(h + 22, m->size);
+  put16(h + 26, nameLength);
+  put16(h + 28, 0);		// extra field
+  return fwrite(h, sizeof(h), 1, f) == 1 &&
+    fwrite(m->name, nameLength, 1, f) == 1;
+}
+
+bool NpzWriter::begin(const char *name, const char *descr,
+		      const long int *shape, int nDims)
+{
+  if( !ok )
+    return false;
+  long int offset = ftell(f);
+  if( nMembers == NPZ_MAX_MEMBERS || offset < 0 || offset > 0xffffffffL )
+  {
+    fprintf(stderr, "npz: too many or too large arrays\n");
+    return ok = false;
+  }
+
+  Member *m = members + nMembers;
+  snprintf(m->name, sizeof(m->name), "%s.npy", name);
+  m->crc = 0;
+  m->size = 0;
+  m->offset = offset;
+  if( !writeLocalHeader(m) )
+    return ok = false;
+  crc = 0;
+  size = 0;
+
+  // the .npy header, padded to a multiple of 64 bytes
+  char dict[256];
+  int n = snprintf(dict, sizeof(dict),
+		   "{'descr': '%s', 'fortran_order': False, 'shape': (", descr);
+  for(int d=0; d<nDims; d++)
+    n += snprintf(dict + n, sizeof(dict) - n, d ? ", %ld" : "%ld", shape[d]);
+  n += snprintf(dict + n, sizeof(dict) - n, nDims == 1 ? ",), }" : "), }");
+  int length = n + 1;
+  length += (64 - (10 + length) % 64) % 64;
+
+  unsigned char h[10 + 256];
+  memcpy(h, "\x93NUMPY\x01\x00", 8);
+  put16(h + 8, length);
+  memcpy(h + 10, dict, n);
+  memset(h + 10 + n, ' ', length - n - 1);
+  h[10 + length - 1] = '\n';
+  return write(h, 10 + length);
+}
+
+bool NpzWriter::write(const void *data, size_t bytes)
+{
+  if( !ok )
+    return false;
+  crc = updateCrc(crc, (const unsigned char *)data, bytes);
+  size += bytes;
+  if( bytes > 0 && fwrite(data, bytes, 1, f) != 1 )
+  {
+    perror("npz");
+    return ok = false;
+  }
+  return true;
+}
+
+bool NpzWriter::end()
+{
+  if( !ok )
+    return false;
+  if( size > 0xffffffffUL )
+  {
+    fprintf(stderr, "npz: array %s is larger than 4GB\n", members[nMembers].name);
+    return ok = false;
+  }
+
+  // the header again, now with the checksum and the size
+  Member *m = members + nMembers;
+  m->crc = crc;
+  m->size = size;
+  if( fseek(f, m->offset, SEEK_SET) < 0 || !writeLocalHeader(m) ||
+      fseek(f, 0, SEEK_END) < 0 )
+  {
+    perror("npz");
+    return ok = false;
+  }
+  nMembers++;
+  return true;
+}
+
+bool NpzWriter::array(const char *name, const char *descr,
+		      const long int *shape, int nDims,
+		      const void *data, size_t bytes)
+{
+  return begin(name, descr, shape, nDims) && write(data, bytes) && end();
+}
+
+bool NpzWriter::close()
+{
+  if( !f )
+    return false;
+
+  long int start = ftell(f);
+  for(int i=0; ok && i<nMembers; i++)
+  {
+    const Member *m = members + i;
+    size_t nameLength = strlen(m->name);
+    unsigned char h[46];
+    put32(h, 0x02014b50);
+    put16(h + 4, 20);		// made by
+    put16(h + 6, 20);		// needed
+    put16(h + 8, 0);
+    put16(h + 10, 0);
+    put16(h + 12, 0);
+    put16(h + 14, 0x21);
+    put32(h + 16, m->crc);
+    put32(h + 20, m->size);
+    put32(h + 24, m->size);
+    put16(h + 28, nameLength);
+    put16(h + 30, 0);		// extra field
+    put16(h + 32, 0);		// comment
+    put16(h + 34, 0);		// disk
+    put16(h + 36, 0);		// internal attributes
+    put32(h + 38, 0);		// external attributes
+    put32(h + 42, m->offset);
+    if( fwrite(h, sizeof(h), 1, f) != 1 || fwrite(m->name, nameLength, 1, f) != 1 )
+    {
+      perror("npz");
+      ok = false;
+    }
+  }
+  long int end = ftell(f);
+  if( ok && (start < 0 || end > 0xffffffffL) )
+  {
+    fprintf(stderr, "npz: the file is larger than 4GB\n");
+    ok = false;
+  }
+
+  unsigned char e[22];
+  put32(e, 0x06054b50);
+  put16(e + 4, 0);
+  put16(e + 6, 0);
+  put16(e + 8, nMembers);
+  put16(e + 10, nMembers);
+  put32(e + 12, end - start);
+  put32(e + 16, start);
+  put16(e + 20, 0);
+  if( ok && fwrite(e, sizeof(e), 1, f) != 1 )
+  {
+    perror("npz");
+    ok = false;
+  }
+
+  if( fclose(f) != 0 )
+  {
+    perror("npz");
+    ok = false;
+  }
+  f = 0;
+  return ok;
+}
@@ -0,0 +1,77 @@
+/***************************************************************************
+ *   Copyright (C) 2003 by Matthias H. Hennig                              *
+ *   hennig@cn.stir.ac.uk                                                  *
+ *   Copyright (C) 2005 by Bernd Porr                                      *
+ *   mail@berndporr.me.uk                                                  *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#ifndef NPZWRITER_H
+#define NPZWRITER_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+// members of one file at most
+#define NPZ_MAX_MEMBERS 32
+// stdio buffer, so that the disk sees large sequential writes
+#define NPZ_BUFFER_BYTES (1024*1024)
+
+/**
+ * Writes NumPy arrays into a .npz file, i.e. .npy files in an
+ * uncompressed zip archive, which numpy.load() reads. The data of an
+ * array is streamed in with write() in any number of pieces, in C
+ * order, the checksum is worked out on the way and filled in by end().
+ * Members and the whole file are limited to 4GB (no zip64).
+ **/
+class NpzWriter
+{
+public:
+
+  NpzWriter();
+  ~NpzWriter();
+
+  bool open(const char *filename);
+
+  /// starts the array name.npy with the numpy type descr (e.g. "<f8")
+  /// and nDims dimensions, 0 for a scalar
+  bool begin(const char *name, const char *descr,
+	     const long int *shape, int nDims);
+  bool write(const void *data, size_t bytes);
+  bool end();
+
+  /// a whole array in one go
+  bool array(const char *name, const char *descr,
+	     const long int *shape, int nDims, const void *data, size_t bytes);
+
+  /// writes the directory, false if anything went wrong on the way
+  bool close();
+
+private:
+
+  struct Member
+  {
+    char name[64];
+    uint32_t crc;
+    uint32_t size;
+    uint32_t offset;
+  };
+
+  bool writeLocalHeader(const Member *m);
+
+  FILE *f;
+  char *buffer;
+  bool ok;
+
+  Member members[NPZ_MAX_MEMBERS];
+  int nMembers;
+  // of the member being written
+  uint32_t crc;
+  uint64_t size;
+};
+
+#endif
@@ -18,140 +18,60 @@
 #include <QPrinter>
 #include <QPrintDialog>
 #include <QFileDialog>
-#include <QTextStream>
 #include <QComboBox>
 
-MainWindow::MainWindow( QWidget *parent ) :
+MainWindow::MainWindow( SampleSource *source, QWidget *parent ) :
     QWidget(parent),
     adChannel(0),
     psthLength(1000),
     psthBinw(20),
     spikeThres(1),
-    psthOn(0),
-    spikeDetected(false),
-    time(0),
-    linearAverage(0)
+    preTrigger(0),
+    kernelWidth(KERNEL_WIDTH),
+    source(source),
+    recorder(0),
+    recorderDropped(0),
+    timeData(0),
+    frameTimer(0),
+    rawDirty(true),
+    undrawn(0),
+    replotPeriod(1.0 / MAX_FRAME_RATE),
+    lastReplot(0),
+    publisher(0),
+    publishFrom(0),
+    publishedTime(0),
+    statsScans(0),
+    statsTime(0)
 {
-  // initialize comedi
-  const char *filename = "/dev/comedi0";
-
-  /* open the device */
-  if( (dev = comedi_open(filename)) == 0 )
-  {
-    comedi_perror(filename);
+  if( source->open() < 0 )
     exit(1);
-  }
-
-  // do not produce NAN for out of range behaviour
-  comedi_set_global_oor_behavior(COMEDI_OOR_NUMBER); 
-
-  maxdata = comedi_get_maxdata(dev, COMEDI_SUB_DEVICE, 0);
-  crange = comedi_get_range(dev,COMEDI_SUB_DEVICE,0,0);
-  numChannels = comedi_get_n_channels(dev, COMEDI_SUB_DEVICE);
-
-  chanlist = new unsigned[numChannels];
-
-  /* Set up channel list */
-  for( int i=0; i<numChannels; i++ )
-    chanlist[i] = CR_PACK(i, COMEDI_RANGE_ID, AREF_GROUND);
-
-  int ret = comedi_get_cmd_generic_timed( dev,
-                                          COMEDI_SUB_DEVICE,
-                                          &comediCommand,
-                                          numChannels,
-                                          (int)(1e9/(SAMPLING_RATE)) );
-
-  if(ret < 0)
-  {
-    printf("comedi_get_cmd_generic_timed failed\n");
-    exit(-1);
-  }
-
-  /* Modify parts of the command */
-  comediCommand.chanlist = chanlist;
-  comediCommand.stop_src = TRIG_NONE;
-  comediCommand.stop_arg = 0;
-
-  /* comedi_command_test() tests a command to see if the
-   * trigger sources and arguments are valid for the subdevice.
-   * If a trigger source is invalid, it will be logically ANDed
-   * with valid values (trigger sources are actually bitmasks),
-   * which may or may not result in a valid trigger source.
-   * If an argument is invalid, it will be adjusted to the
-   * nearest valid value.  In this way, for many commands, you
-   * can test it multiple times until it passes.  Typically,
-   * if you can't get a valid command in two tests, the original
-   * command wasn't specified very well. */
-  ret = comedi_command_test(dev, &comediCommand);
-
-  if(ret < 0)
-  {
-    comedi_perror("comedi_command_test");
-    exit(-1);
-  }
-
-  fprintf(stderr, "first test returned %d\n", ret);
-
-  ret = comedi_command_test(dev, &comediCommand);
-  if(ret < 0)
-  {
-    comedi_perror("comedi_command_test");
-    exit(-1);
-  }
-
-  fprintf(stderr, "second test returned %d\n", ret);
-
-  if(ret != 0)
-  {
-    fprintf(stderr,"Error preparing command\n");
-    exit(-1);
-  }
-
-  // the timing is done channel by channel
-  // this means that the actual sampling rate is divided by
-  // number of channels
-  if ((comediCommand.convert_src ==  TRIG_TIMER)&&(comediCommand.convert_arg)) {
-	  sampling_rate=(((double)1E9 / comediCommand.convert_arg)/numChannels);
-  }
-  
-  // the timing is done scan by scan (all channels at once)
-  // the sampling rate is equivalent of the scan_begin_arg
-  if ((comediCommand.scan_begin_src ==  TRIG_TIMER)&&(comediCommand.scan_begin_arg)) {
-	  sampling_rate=(double)1E9 / comediCommand.scan_begin_arg;
-  }
 
-  // 50Hz or 60Hz mains notch filter
-  iirnotch = new Iir::Butterworth::BandStop<IIRORDER>;
-  assert( iirnotch != NULL );
-  iirnotch->setup (IIRORDER, sampling_rate, NOTCH_F, NOTCH_F/10.0);
+  numChannels = source->numChannels();
+  sampling_rate = source->samplingRate();
+  crange = source->range();
 
-  /* start the command */
-  ret = comedi_command(dev, &comediCommand);
-  if(ret < 0)
-  {
-    comedi_perror("comedi_command");
-    exit(1);
-  }
+  processor = new PsthProcessor(numChannels, sampling_rate);
+  processor->setPsthLength(toSamples(psthLength));
+  processor->setBinWidth(toSamples(psthBinw));
+  processor->setThreshold(spikeThres);
+  smoothedRate = new SmoothedRate(processor);
 
-  int subdev_flags = comedi_get_subdevice_flags(dev, COMEDI_SUB_DEVICE);
+  stats = new PipelineStats;
+  processor->setStats(stats);
 
-  if( (sigmaBoard = subdev_flags & SDF_LSAMPL) )
-    readSize = sizeof(lsampl_t) * numChannels;
-  else
-    readSize = sizeof(sampl_t) * numChannels;
+  // the source is drained on its own thread so that a slow replot
+  // can never stall the acquisition
+  sampleRing = new SampleRing(numChannels,
+			      (int)(sampling_rate * SAMPLE_RING_SECONDS));
+  acquisition = new AcquisitionThread(source, sampleRing);
+  acquisition->setStats(stats);
+  acquisition->start();
 
-  //  Initialize data for plots
-  for(int i=0; i<MAX_PSTH_LENGTH; i++)
-  {
-    xData[i] = i;     // time axis
-    yData[i] = 0;
-    timeData[i] = double(i)*psthBinw; // psth time axis
-    spikeCountData[i] = 0;
-    psthData[i] = 0;
-  }
+  spectrum = new SpectrumAnalyser(sampling_rate);
+  spectrum->start();
 
   // the gui, straight forward QT/Qwt
-  resize(640,420);
+  resize(900,600);
   QHBoxLayout *mainLayout = new QHBoxLayout( this );
 
   QVBoxLayout *controlLayout = new QVBoxLayout;
@@ -161,17 +81,30 @@ MainWindow::MainWindow( QWidget *parent ) :
   plotLayout->addStrut(400);
   mainLayout->addLayout(plotLayout);
 
-  // two plots
-  RawDataPlot = new DataPlot(xData, yData, psthLength, 
+  // two plots, the raw data with its spectrum beside it
+  QHBoxLayout *rawLayout = new QHBoxLayout;
+  plotLayout->addLayout(rawLayout);
+
+  RawDataPlot = new DataPlot(toSamples(psthLength), sampling_rate,
 			     crange->max, crange->min, this);
-  plotLayout->addWidget(RawDataPlot);
+  rawLayout->addWidget(RawDataPlot, 2);
   RawDataPlot->show();
 
+  MySpectrumPlot = new SpectrumPlot(spectrum, this);
+  rawLayout->addWidget(MySpectrumPlot, 1);
+  MySpectrumPlot->show();
+
   plotLayout->addSpacing(20);
 
-  MyPsthPlot = new PsthPlot(timeData, psthData, psthLength/psthBinw, this);
+  // the data is handed over by updatePsthPlot() below
+  MyPsthPlot = new PsthPlot(0, processor->psth(adChannel), 0, this);
   plotLayout->addWidget(MyPsthPlot);
   MyPsthPlot->show();
+  connect(MyPsthPlot, SIGNAL(aboutToReplot()), SLOT(slotUpdatePsth()));
+
+  MyRasterPlot = new RasterPlot(processor, this);
+  plotLayout->addWidget(MyRasterPlot);
+  MyRasterPlot->show();
 
   /*---- Buttons ----*/
 
@@ -190,9 +123,16 @@ MainWindow::MainWindow( QWidget *parent ) :
   ADcounterLayout->addWidget(cntChannel);
   connect(cntChannel, SIGNAL(valueChanged(double)), SLOT(slotSetChannel(double)));
 
-  filter50HzCheckBox = new QCheckBox( "50Hz filter" );
+  filter50HzCheckBox = new QCheckBox( "mains filter" );
   filter50HzCheckBox->setEnabled( true );
   ADcounterLayout->addWidget(filter50HzCheckBox);
+  connect(filter50HzCheckBox, SIGNAL(stateChanged(int)), SLOT(slotFilter50Hz(int)));
+
+  notchFrequency = new QComboBox(ADcounterGroup);
+  notchFrequency->addItem(tr("50Hz"));
+  notchFrequency->addItem(tr("60Hz"));
+  ADcounterLayout->addWidget(notchFrequency);
+  connect( notchFrequency, SIGNAL(currentIndexChanged(int)), SLOT(slotNotchFrequency(int)) );
 
   // psth functions
   QGroupBox   *PSTHfunGroup  = new QGroupBox( "Actions", this );
@@ -220,10 +160,16 @@ MainWindow::MainWindow( QWidget *parent ) :
   PSTHfunLayout->addWidget(clearPsth);
   connect(clearPsth, SIGNAL(clicked()), SLOT(slotClearPsth()));
 
-  QPushButton *savePsth = new QPushButton(PSTHfunGroup);
-  savePsth->setText("save data");
-  PSTHfunLayout->addWidget(savePsth);
-  connect(savePsth, SIGNAL(clicked()), SLOT(slotSavePsth()));
+  saveData = new QPushButton(PSTHfunGroup);
+  saveData->setText("save data");
+  PSTHfunLayout->addWidget(saveData);
+  connect(saveData, SIGNAL(clicked()), SLOT(slotSavePsth()));
+
+  recordRaw = new QPushButton(PSTHfunGroup);
+  recordRaw->setText("record raw");
+  recordRaw->setCheckable(true);
+  PSTHfunLayout->addWidget(recordRaw);
+  connect(recordRaw, SIGNAL(clicked()), SLOT(slotRecord()));
 
   // psth params
   QGroupBox   *PSTHcounterGroup = new QGroupBox( "Parameters", this );
@@ -238,11 +184,11 @@ MainWindow::MainWindow( QWidget *parent ) :
   QLabel *psthLengthLabel = new QLabel("Sweep length", PSTHcounterGroup);
   PSTHcounterLayout->addWidget(psthLengthLabel);
 
-  QwtCounter *cntSLength = new QwtCounter(PSTHcounterGroup);
+  cntSLength = new QwtCounter(PSTHcounterGroup);
   cntSLength->setNumButtons(2);
   cntSLength->setIncSteps(QwtCounter::Button1, 10);
   cntSLength->setIncSteps(QwtCounter::Button2, 100);
-  cntSLength->setRange(1, MAX_PSTH_LENGTH, 1);
+  cntSLength->setRange(1, MAX_SWEEP_LENGTH, 1);
   cntSLength->setValue(psthLength);
   PSTHcounterLayout->addWidget(cntSLength);
   connect(cntSLength, 
@@ -261,6 +207,47 @@ MainWindow::MainWindow( QWidget *parent ) :
   PSTHcounterLayout->addWidget(cntBinw);
   connect(cntBinw, SIGNAL(valueChanged(double)), SLOT(slotSetPsthBinw(double)));
 
+  QLabel *smoothingLabel = new QLabel("Smoothing", PSTHcounterGroup);
+  PSTHcounterLayout->addWidget(smoothingLabel);
+
+  smoothing = new QComboBox(PSTHcounterGroup);
+  smoothing->addItem(tr("none"));
+  smoothing->addItem(tr("Gaussian"));
+  smoothing->addItem(tr("exponential"));
+  PSTHcounterLayout->addWidget(smoothing);
+  connect( smoothing, SIGNAL(currentIndexChanged(int)), SLOT(slotSmoothing(int)) );
+
+  QwtCounter *cntKernelWidth = new QwtCounter(PSTHcounterGroup);
+  cntKernelWidth->setNumButtons(2);
+  cntKernelWidth->setIncSteps(QwtCounter::Button1, 1);
+  cntKernelWidth->setIncSteps(QwtCounter::Button2, 10);
+  cntKernelWidth->setRange(1, 1000, 1);
+  cntKernelWidth->setValue(kernelWidth);
+  PSTHcounterLayout->addWidget(cntKernelWidth);
+  connect(cntKernelWidth, SIGNAL(valueChanged(double)), SLOT(slotKernelWidth(double)));
+
+  QLabel *triggerLabel = new QLabel("Trigger", PSTHcounterGroup);
+  PSTHcounterLayout->addWidget(triggerLabel);
+
+  triggerSource = new QComboBox(PSTHcounterGroup);
+  triggerSource->addItem(tr("free running"));
+  for(int c=0; c<numChannels; c++)
+    triggerSource->addItem(tr("channel %1").arg(c));
+  PSTHcounterLayout->addWidget(triggerSource);
+  connect( triggerSource, SIGNAL(currentIndexChanged(int)), SLOT(slotTriggerSource(int)) );
+
+  QLabel *preTriggerLabel = new QLabel("Pre-trigger", PSTHcounterGroup);
+  PSTHcounterLayout->addWidget(preTriggerLabel);
+
+  QwtCounter *cntPreTrigger = new QwtCounter(PSTHcounterGroup);
+  cntPreTrigger->setNumButtons(2);
+  cntPreTrigger->setIncSteps(QwtCounter::Button1, 10);
+  cntPreTrigger->setIncSteps(QwtCounter::Button2, 100);
+  cntPreTrigger->setRange(0, MAX_SWEEP_LENGTH, 1);
+  cntPreTrigger->setValue(preTrigger);
+  PSTHcounterLayout->addWidget(cntPreTrigger);
+  connect(cntPreTrigger, SIGNAL(valueChanged(double)), SLOT(slotPreTrigger(double)));
+
   QLabel *thresholdLabel = new QLabel("Spike Threshold", PSTHcounterGroup);
   PSTHcounterLayout->addWidget(thresholdLabel);
 
@@ -279,112 +266,304 @@ MainWindow::MainWindow( QWidget *parent ) :
   thresholdMarker->attach(RawDataPlot);
   thresholdMarker->setLineStyle(QwtPlotMarker::HLine);
 
-  // Generate timer event every 50ms
-  (void)startTimer(50);
+  // spike sorting
+  QGroupBox   *sortGroup = new QGroupBox( "Spike sorting", this );
+  QVBoxLayout *sortLayout = new QVBoxLayout;
+
+  sortGroup->setLayout(sortLayout);
+  sortGroup->setAlignment(Qt::AlignJustify);
+  sortGroup->setSizePolicy( QSizePolicy(QSizePolicy::Fixed, QSizePolicy::Fixed) );
+  controlLayout->addWidget( sortGroup );
+
+  unitSelect = new QComboBox(sortGroup);
+  unitSelect->addItem(tr("all spikes"));
+  for(int u=0; u<SORT_MAX_UNITS; u++)
+    unitSelect->addItem(tr("unit %1").arg(u + 1));
+  sortLayout->addWidget(unitSelect);
+  connect( unitSelect, SIGNAL(currentIndexChanged(int)), SLOT(slotShowUnit(int)) );
+
+  sortLabel = new QLabel(sortGroup);
+  sortLayout->addWidget(sortLabel);
+
+  QPushButton *addTemplate = new QPushButton(sortGroup);
+  addTemplate->setText("add template");
+  sortLayout->addWidget(addTemplate);
+  connect(addTemplate, SIGNAL(clicked()), SLOT(slotAddTemplate()));
+
+  QPushButton *clearTemplates = new QPushButton(sortGroup);
+  clearTemplates->setText("clear templates");
+  sortLayout->addWidget(clearTemplates);
+  connect(clearTemplates, SIGNAL(clicked()), SLOT(slotClearTemplates()));
+
+  QPushButton *saveTemplates = new QPushButton(sortGroup);
+  saveTemplates->setText("save templates");
+  sortLayout->addWidget(saveTemplates);
+  connect(saveTemplates, SIGNAL(clicked()), SLOT(slotSaveTemplates()));
+
+  updateSorting();
+
+  // pipeline statistics
+  QGroupBox   *statsGroup = new QGroupBox( "Statistics", this );
+  QVBoxLayout *statsLayout = new QVBoxLayout;
+
+  statsGroup->setLayout(statsLayout);
+  statsGroup->setSizePolicy( QSizePolicy(QSizePolicy::Fixed, QSizePolicy::Fixed) );
+  controlLayout->addWidget( statsGroup );
+
+  statsLabel = new QLabel(statsGroup);
+  statsLayout->addWidget(statsLabel);
+  updateStats();
+
+  updatePsthPlot();
+
+  setFrameRate(MAX_FRAME_RATE);
 
 }
 
 MainWindow::~MainWindow()
 {
-  delete[] chanlist;
+  delete acquisition;
+  delete spectrum;
+  delete publisher;
+  delete[] publishFrom;
+  delete recorder;
+  delete source;
+  delete sampleRing;
+  delete smoothedRate;
+  delete processor;
+  delete stats;
+  delete[] timeData;
 }
 
-void MainWindow::slotSavePsth()
+int MainWindow::toSamples(double ms) const
 {
-  QString fileName = QFileDialog::getSaveFileName();
+  int n = (int)(ms * sampling_rate / 1000 + 0.5);
+  return n < 1 ? 1 : n;
+}
 
-  if( !fileName.isNull() )
+int MainWindow::shownTrain() const
+{
+  // the VEP has no units
+  int u = unitSelect->currentIndex() - 1;
+  if( u < 0 || averagePsth->currentIndex() > 0 )
+    return adChannel;
+  return processor->unitTrain(adChannel, u);
+}
+
+void MainWindow::updatePsthPlot()
+{
+  // the processor reallocates its buffers when the parameters change
+  int train = shownTrain();
+  int nBins = processor->numBins();
+  delete[] timeData;
+  timeData = new double[nBins];
+  for(int i=0; i<nBins; i++)
+    timeData[i] = (i * processor->binSamples() -
+		   processor->preTriggerSamples()) * 1000.0 / sampling_rate;
+
+  MyPsthPlot->setTimeData(timeData);
+  MyPsthPlot->setPsthLength(nBins);
+  MyPsthPlot->setPsthData(processor->psth(train));
+  if( averagePsth->currentIndex() > 0 )
   {
-    QFile file(fileName);
+    processor->updateSem(train, 0, nBins - 1);
+    MyPsthPlot->setSemData(processor->sem(train));
+  }
+  else
+    MyPsthPlot->setSemData(0);
+  resetRate();
+  MyPsthPlot->refresh();
+  MyRasterPlot->setChannel(train);
+}
 
-    if( file.open(QIODevice::WriteOnly | QFile::Truncate) )
-    {
-      QTextStream out(&file);
+void MainWindow::resetRate()
+{
+  // the smoothed rate only makes sense for spikes
+  smoothedRate->setTrain(shownTrain());
+  smoothedRate->update();
+  if( processor->smoothingKernel() != KERNEL_NONE &&
+      averagePsth->currentIndex() == 0 )
+    MyPsthPlot->setRateData(smoothedRate->time(), smoothedRate->rate(),
+			    smoothedRate->length());
+  else
+    MyPsthPlot->setRateData(0, 0, 0);
+}
+
+void MainWindow::setFrameRate(double fps)
+{
+  if( fps <= 0 )
+    fps = MAX_FRAME_RATE;
+  // the replots are checked for on every drain of the ring
+  if( fps > 1000 / DRAIN_PERIOD )
+    fps = 1000 / DRAIN_PERIOD;
+  replotPeriod = 1 / fps;
+  if( !frameTimer )
+    frameTimer = startTimer(DRAIN_PERIOD);
+  // the PSTH changes more slowly than the raw data
+  MyPsthPlot->setFrameRate(fps < PSTH_FRAME_RATE ? fps : PSTH_FRAME_RATE);
+}
+
+void MainWindow::slotSavePsth()
+{
+  QString numpy = tr("NumPy (*.npz)");
+  QString filter = numpy;
+  QString fileName = QFileDialog::getSaveFileName(this, QString(), QString(),
+						  numpy + ";;" + tr("Text (*)"),
+						  &filter);
 
-      for(int i=0; i<psthLength/psthBinw; i++)
-        out << timeData[i] << "\t" << psthData[i] << "\n";
+  if( fileName.isNull() )
+    return;
 
-      file.close();
-    }
-    else
+  if( filter == numpy || fileName.endsWith(".npz") )
+  {
+    if( !fileName.endsWith(".npz") )
+      fileName += ".npz";
+    // written in the background, the button comes back when it is done
+    if( processor->startExport(fileName.toLocal8Bit().constData()) )
+      saveData->setEnabled(false);
+  }
+  else
+  {
+    // one column per channel
+    if( !processor->save(fileName.toLocal8Bit().constData()) )
     {
       // TODO: warning box
     }
   }
 }
 
-void MainWindow::slotClearPsth()
+void MainWindow::slotRecord()
 {
-  time = 0;
-  for(int i=0; i<psthLength/psthBinw; i++) {
-    psthData[i] = 0;
-    spikeCountData[i] = 0;
+  if( !recorder )
+  {
+    QString fileName = QFileDialog::getSaveFileName();
+
+    if( !fileName.isNull() )
+    {
+      recorder = new RecordingWriter(source);
+      if( recorder->open(fileName.toLocal8Bit().constData()) )
+	acquisition->setRecorder(recorder);
+      else
+      {
+	delete recorder;
+	recorder = 0;
+      }
+    }
+  }
+  else
+  {
+    acquisition->setRecorder(0);
+    recorder->close();
+    recorderDropped += recorder->dropped();
+    delete recorder;
+    recorder = 0;
   }
-  spikeDetected = false;
-  psthActTrial = 0;
-  MyPsthPlot->replot();
+  recordRaw->setChecked(recorder != 0);
+}
+
+void MainWindow::slotClearPsth()
+{
+  processor->clear();
+  // the trials are counted from zero again
+  resetRate();
+  slotUpdatePsth();
+  MyPsthPlot->refresh();
+  MyRasterPlot->reset();
 }
 
 void MainWindow::slotTriggerPsth()
 {
-	if(psthOn == 0)
+	if( !processor->isOn() )
 	{
-		for(int i=0; i<psthLength/psthBinw; i++) {
-			psthData[i] = 0;
-			spikeCountData[i] = 0;
-		}
-		psthActTrial = 0;
-		psthOn = 1;
-		time = 0;
+		processor->start();
+		// the spikes and trials start from scratch
+		resetRate();
+		MyRasterPlot->reset();
+		MyPsthPlot->refresh();
 		MyPsthPlot->startDisplay();
-		psthOn = 1;
-		psthActTrial = 0;
-		time = 0;
 	}
 	else
 	{
 		MyPsthPlot->stopDisplay();
-		psthOn = 0;
-		psthActTrial = 0;
-		spikeDetected = false;
+		processor->stop();
 	}
 }
 
 void MainWindow::slotSetChannel(double c)
 {
+  // only changes what is shown, every channel keeps its own PSTH
   adChannel = (int)c;
-  spikeDetected = false;
+  spectrum->clear();
+  updateSorting();
+  updatePsthPlot();
 }
 
 void MainWindow::slotSetPsthLength(double l)
 {
-  psthLength = (int)l;
-
-  for(int i=0; i<psthLength/psthBinw; i++) {
-    psthData[i] = 0;
-    spikeCountData[i] = 0;
-    timeData[i] = double(i)*psthBinw;
+  if( !processor->setPsthLength(toSamples(l)) )
+  {
+    fprintf(stderr, "A sweep of %d ms needs too much memory\n", (int)l);
+    // back to the old length, without coming here again
+    cntSLength->blockSignals(true);
+    cntSLength->setValue(psthLength);
+    cntSLength->blockSignals(false);
+    return;
   }
-  spikeDetected = false;
-  psthActTrial = 0;
-  time = 0;
+  psthLength = (int)l;
 
-  RawDataPlot->setPsthLength((int) l);
-  MyPsthPlot->setPsthLength(psthLength/psthBinw);
+  RawDataPlot->setPsthLength(toSamples(psthLength));
+  updatePsthPlot();
 }
 
 void MainWindow::slotSetPsthBinw(double b)
 {
-  psthBinw = (int)b;
-  for(int i=0; i<psthLength/psthBinw; i++) {
-    psthData[i] = 0;
-    spikeCountData[i] = 0;
-    timeData[i] = double(i)*psthBinw;
+  if( !processor->setBinWidth(toSamples(b)) )
+  {
+    fprintf(stderr, "A bin width of %d ms needs too much memory\n", (int)b);
+    cntBinw->blockSignals(true);
+    cntBinw->setValue(psthBinw);
+    cntBinw->blockSignals(false);
+    return;
   }
-  spikeDetected = false;
-  psthActTrial = 0;
-  time = 0;
-  MyPsthPlot->setPsthLength(psthLength/psthBinw);
+  psthBinw = (int)b;
+  updatePsthPlot();
+}
+
+void MainWindow::setTrigger()
+{
+  // ms to samples, but zero stays zero
+  int pre = preTrigger ? toSamples(preTrigger) : 0;
+  processor->setTrigger(triggerSource->currentIndex() - 1, TRIGGER_LEVEL, pre);
+  updatePsthPlot();
+}
+
+void MainWindow::setSmoothing()
+{
+  processor->setSmoothing((SmoothingKernel)smoothing->currentIndex(),
+			  kernelWidth * sampling_rate / 1000);
+  updatePsthPlot();
+}
+
+void MainWindow::slotSmoothing(int)
+{
+  setSmoothing();
+}
+
+void MainWindow::slotKernelWidth(double w)
+{
+  kernelWidth = (int)w;
+  setSmoothing();
+}
+
+void MainWindow::slotTriggerSource(int)
+{
+  setTrigger();
+}
+
+void MainWindow::slotPreTrigger(double p)
+{
+  preTrigger = (int)p;
+  setTrigger();
 }
 
 void MainWindow::slotSetSpikeThres()
@@ -392,13 +571,158 @@ void MainWindow::slotSetSpikeThres()
 	QString t = editSpikeT->toPlainText();
 	spikeThres = t.toFloat();
 	thresholdMarker->setValue(0,spikeThres);
+	rawDirty = true;
 	printf("%lf\n",spikeThres);
-	spikeDetected = false;
+	processor->setThreshold(spikeThres);
+}
+
+void MainWindow::slotFilter50Hz(int state)
+{
+	processor->setFilter(state == Qt::Checked);
+}
+
+void MainWindow::slotUpdatePsth()
+{
+  // the raster only paints the spikes which are new
+  MyRasterPlot->refresh();
+  // and the smoothed rate only counts the trials which have ended
+  if( processor->smoothingKernel() != KERNEL_NONE && smoothedRate->update() )
+    MyPsthPlot->setRateDirty();
+
+  int first, last;
+  int train = shownTrain();
+  if( !processor->takeDirty(train, &first, &last) )
+    return;
+  // the standard error is only worked out when it is drawn
+  processor->updateSem(train, first, last);
+  MyPsthPlot->setDirty(first, last);
+}
+
+void MainWindow::slotShowUnit(int)
+{
+  updatePsthPlot();
+}
+
+void MainWindow::updateSorting()
+{
+  const SpikeSorter *sorter = processor->sorter();
+  sortLabel->setText(tr("%1 templates, %2 snippets")
+		     .arg(sorter->numUnits(adChannel))
+		     .arg(sorter->numSnippets(adChannel)));
+}
+
+void MainWindow::slotAddTemplate()
+{
+  // the mean of the latest spikes, e.g. after setting the threshold
+  // so that only one unit crosses it
+  const SpikeSorter *sorter = processor->sorter();
+  double *shape = new double[sorter->length()];
+  double rms;
+  if( sorter->average(adChannel, SORT_TEMPLATE_SNIPPETS, shape, &rms) > 0 )
+  {
+    int unit = processor->addTemplate(adChannel, shape, SORT_TOLERANCE * rms);
+    if( unit != UNIT_REJECTED )
+      unitSelect->setCurrentIndex(unit + 1);
+  }
+  delete[] shape;
+  if( publisher )
+    restartEvents(processor->samples());
+  updateSorting();
+  updatePsthPlot();
+}
+
+void MainWindow::slotClearTemplates()
+{
+  processor->clearTemplates(adChannel);
+  if( publisher )
+    restartEvents(processor->samples());
+  unitSelect->setCurrentIndex(0);
+  updateSorting();
+  updatePsthPlot();
+}
+
+void MainWindow::slotSaveTemplates()
+{
+  QString fileName = QFileDialog::getSaveFileName();
+
+  if( !fileName.isNull() )
+    processor->sorter()->saveTemplates(fileName.toLocal8Bit().constData());
+}
+
+bool MainWindow::loadTemplates(const char *filename)
+{
+  bool ok = processor->loadTemplates(filename);
+  if( publisher )
+    restartEvents(processor->samples());
+  updateSorting();
+  updatePsthPlot();
+  return ok;
+}
+
+bool MainWindow::publish(const char *name)
+{
+  publisher = new LivePublisher(numChannels, SORT_MAX_UNITS, sampling_rate);
+  if( !publisher->open(name) )
+  {
+    delete publisher;
+    publisher = 0;
+    return false;
+  }
+  publishFrom = new uint64_t[processor->numTrains()];
+  restartEvents(processor->samples());
+  return true;
+}
+
+void MainWindow::restartEvents(long int time)
+{
+  // e.g. the units sorted again with new templates are not news
+  for(int t=0; t<processor->numTrains(); t++)
+    publishFrom[t] = time;
+  publishedTime = time;
+}
+
+void MainWindow::publishBlock(const double *scans, int nScans, long int time)
+{
+  // the processor's clock starts again when the PSTH is cleared
+  if( time < publishedTime )
+    restartEvents(time);
+
+  // from the processor's clock to the scan numbers of the stream,
+  // sorted spikes may belong to an earlier block
+  uint64_t offset = publisher->scans() - time;
+  publisher->publish(scans, nScans);
+
+  for(int t=0; t<processor->numTrains(); t++)
+  {
+    const SpikeArena &spikes = processor->spikes(t);
+    long int i = spikes.lowerBound(publishFrom[t]);
+    if( i == spikes.size() )
+      continue;
+    for(; i<spikes.size(); i++)
+      publisher->publishEvent(spikes[i] + offset, t);
+    publishFrom[t] = spikes[spikes.size() - 1] + 1;
+  }
+  // the clock stands still while the PSTH is off
+  publishedTime = processor->samples();
+}
+
+void MainWindow::slotNotchFrequency(int idx)
+{
+	processor->setNotchFrequency(idx > 0 ? 60 : 50);
 }
 
 void MainWindow::slotAveragePsth(int idx)
 {
-	linearAverage = (idx>0);
+	int linearAverage = (idx>0);
+	if( !processor->setAverage(linearAverage) )
+	{
+		fprintf(stderr, "The sweep is too long for the %s\n",
+			linearAverage ? "VEP" : "PSTH");
+		averagePsth->blockSignals(true);
+		averagePsth->setCurrentIndex(!linearAverage);
+		averagePsth->blockSignals(false);
+		return;
+	}
 	if ( linearAverage )
 	{
 		cntBinw->setEnabled(false);
@@ -406,6 +730,7 @@ void MainWindow::slotAveragePsth(int idx)
 		MyPsthPlot->setYaxisLabel("Averaged Data");
 		MyPsthPlot->setAxisTitle(QwtPlot::yLeft, "average/V");
 		MyPsthPlot->setTitle("VEP");
+		MyRasterPlot->hide();
 		triggerPsth->setText("Averaging on");
 		psthBinw = 1;
 		cntBinw->setValue(psthBinw);
@@ -417,70 +742,108 @@ void MainWindow::slotAveragePsth(int idx)
 		MyPsthPlot->setYaxisLabel("Spikes/s");
 		MyPsthPlot->setAxisTitle(QwtPlot::yLeft, "Spikes/s");
 		MyPsthPlot->setTitle("PSTH");
+		MyRasterPlot->show();
 		triggerPsth->setText("PSTH on");
 	}
+	updatePsthPlot();
 }
 
 void MainWindow::timerEvent(QTimerEvent *)
 {
-  unsigned char buffer[readSize];
+  if( acquisition->failed() )
+    exit(1);
 
-  while( comedi_get_buffer_contents(dev, COMEDI_SUB_DEVICE) > 0 )
+  // a rebuild may also finish when no data arrives any more, e.g. at
+  // the end of a recording
+  if( processor->mergeRebuild() )
   {
-    if( read(comedi_fileno(dev), buffer, readSize) == 0 )
-    {
-      printf("Error: end of Aquisition\n");
-      exit(1);
-    }
-
-    int v;
-
-    if( sigmaBoard )
-	    v = ((lsampl_t *)buffer)[adChannel];
-    else
-	    v = ((sampl_t *)buffer)[adChannel];
-
-    double yNew = comedi_to_phys(v,
-				 crange,
-				 maxdata);
+    slotUpdatePsth();
+    MyPsthPlot->refresh();
+  }
 
-    if (filter50HzCheckBox->checkState()==Qt::Checked) {
-	    yNew=iirnotch->filter(yNew);
-    }                                
+  const double *scans;
+  int nScans;
 
-    RawDataPlot->setNewData(yNew);
+  while( (nScans = sampleRing->peek(&scans)) > 0 )
+  {
+    // all channels are processed, only one is shown
+    long int time = processor->samples();
+    int n = processor->process(scans, nScans);
+    if( publisher )
+      publishBlock(scans, n, time);
+
+    const double *y = processor->row(adChannel);
+    for(int i=0; i<n; i++)
+      RawDataPlot->setNewData(y[i]);
+    spectrum->push(y, n);
+
+    sampleRing->consume(n);
+    undrawn += n;
+  }
 
-    int trialIndex = time % psthLength;
+  // the frame rate only limits the replots, the ring is drained anyway;
+  // nothing to draw, e.g. at the end of a recording
+  double seconds = stats->elapsed();
+  if( (undrawn > 0 || rawDirty) && seconds - lastReplot >= replotPeriod )
+  {
+    int64_t t = PipelineStats::now();
+    RawDataPlot->replot();
+    stats->record(STAGE_RENDER, PipelineStats::now() - t);
+    stats->displayed(undrawn);
+    undrawn = 0;
+    rawDirty = false;
+    lastReplot = seconds;
+  }
 
-    if( linearAverage && psthOn )
-    {
-      spikeCountData[trialIndex] += yNew;
+  // a few times a second at most
+  if( spectrum->takeSpectrum() )
+    MySpectrumPlot->refresh();
 
-      psthData[trialIndex] = spikeCountData[trialIndex] / (time/psthLength + 1);
-    }
-    else if( !spikeDetected && yNew>spikeThres )
-    {
-      if(psthOn)
-      {
-        int psthIndex = trialIndex / psthBinw;
+  bool exported;
+  if( processor->takeExport(&exported) )
+  {
+    saveData->setEnabled(true);
+    if( !exported )
+      fprintf(stderr, "Could not write the .npz file\n");
+  }
 
-        spikeCountData[psthIndex] += 1;
+  if( stats->elapsed() - statsTime >= STATS_UPDATE_PERIOD )
+  {
+    updateStats();
+    updateSorting();
+  }
+}
 
-        psthData[psthIndex] = ( spikeCountData[psthIndex]*1000 ) / 
-		( psthBinw * (time/psthLength + 1) );
+void MainWindow::updateStats()
+{
+  long int lostRecorder = recorderDropped + (recorder ? recorder->dropped() : 0);
+  stats->setLost(sampleRing->overruns(), lostRecorder);
+
+  // rate since the last update
+  uint64_t scans = stats->scansArrived();
+  double t = stats->elapsed();
+  double rate = t > statsTime ? (scans - statsScans) / (t - statsTime) : 0;
+  statsScans = scans;
+  statsTime = t;
+
+  const StageHistogram &latency = stats->stage(STAGE_LATENCY);
+  const StageHistogram &render = stats->stage(STAGE_RENDER);
+  int size = stats->bufferSize();
+
+  QString text;
+  text += tr("%1 scans/s\n").arg(rate, 0, 'f', 0);
+  text += tr("latency %1/%2 ms\n")
+    .arg(latency.percentile(0.5) * 1e-6, 0, 'f', 1)
+    .arg(latency.percentile(0.99) * 1e-6, 0, 'f', 1);
+  text += tr("render %1 ms\n").arg(render.percentile(0.5) * 1e-6, 0, 'f', 1);
+  if( size > 0 )
+    text += tr("buffer peak %1%\n").arg(100.0 * stats->bufferPeak() / size, 0, 'f', 0);
+  text += tr("lost %1").arg(sampleRing->overruns() + lostRecorder);
+  statsLabel->setText(text);
+}
 
-        spikeDetected = true;
-      }
-    }
-    else if( yNew < spikeThres )
-    {
-      spikeDetected = false;
-    }
-    
-    if( trialIndex == 0 )
-      psthActTrial += 1;
-    
-    ++time;
-  }
-  RawDataPlot->replot();
+bool MainWindow::saveStats(const char *filename)
+{
+  updateStats();
+  return stats->save(filename);
 }
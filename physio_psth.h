@@ -18,25 +18,50 @@
 #include <QTextEdit>
 #include <QCheckBox>
 #include <QComboBox>
+#include <QLabel>
 
 #include <comedilib.h>
 #include <qwt/qwt_counter.h>
 #include <qwt/qwt_plot_marker.h>
 
 #include "psthplot.h"
+#include "rasterplot.h"
+#include "smoothedrate.h"
+#include "spectrumplot.h"
 #include "dataplot.h"
-#include <Iir.h>
+#include "samplering.h"
+#include "samplesource.h"
+#include "acquisitionthread.h"
+#include "recordingwriter.h"
+#include "psthprocessor.h"
+#include "pipelinestats.h"
+#include "livepublisher.h"
+
+// requested from the device, the real rate is taken from the source
+#define SAMPLING_RATE 1000 // 1kHz
 
-// maximal length of the PSTH (for memory alloctaion)
-#define MAX_PSTH_LENGTH 5000
+// upper limit of the sweep length counter in ms
+#define MAX_SWEEP_LENGTH 60000
 
-#define SAMPLING_RATE 1000 // 1kHz
+// seconds of data the acquisition thread can buffer ahead of the GUI
+#define SAMPLE_RING_SECONDS 4
+
+// default upper limit of the raw data replots per second
+#define MAX_FRAME_RATE 20
+
+// the ring is drained every that many ms, whatever the frame rate
+#define DRAIN_PERIOD 10
 
-#define NOTCH_F 50 // filter out 50Hz noise
-#define IIRORDER 6
+// seconds between updates of the statistics panel
+#define STATS_UPDATE_PERIOD 1
 
-#define COMEDI_SUB_DEVICE  0
-#define COMEDI_RANGE_ID    0    /* +/- 4V */
+// default width of the smoothing kernel in ms
+#define KERNEL_WIDTH 10
+
+// a new template is the mean of that many of the latest snippets
+#define SORT_TEMPLATE_SNIPPETS 50
+// and matches up to that many times their RMS spread
+#define SORT_TOLERANCE 3
 
 
 class MainWindow : public QWidget
@@ -47,62 +72,116 @@ class MainWindow : public QWidget
   DataPlot *RawDataPlot;
   // here the PSTH will be shown
   PsthPlot *MyPsthPlot;
+  // and the spikes of every trial here
+  RasterPlot *MyRasterPlot;
+  // power spectrum of the raw data next to it
+  SpectrumPlot *MySpectrumPlot;
   
-  // channel number for the seari device
+  // channel shown in the plots, all of them are analysed
   int adChannel;
-  // length of the PSTH, this is the length on one trial
+  // length of the PSTH in ms, this is the length on one trial
   int psthLength;
-  // bin width for the PSTH
+  // bin width for the PSTH in ms
   int psthBinw;
   // treshold for a spike
   double spikeThres;
+  // part of the sweep before the trigger in ms
+  int preTrigger;
+  // sigma or time constant of the smoothing kernel in ms
+  int kernelWidth;
 
-  // boo, activate/deactivate the psth plot
-  int psthOn;
 
-  // count trials while recording
-  int psthActTrial;
-  
-  // bool, set when a spike is detected and the activity has not
-  // gone back to resting potential
-  bool spikeDetected;
-  
-  // data
-  double xData[MAX_PSTH_LENGTH], yData[MAX_PSTH_LENGTH];
-  // PSTH, t is time, p is spike count, psth is spikes/sec
-  double timeData[MAX_PSTH_LENGTH], spikeCountData[MAX_PSTH_LENGTH], psthData[MAX_PSTH_LENGTH];
-  
-  // serai file desc
-  int usbFd;
-  
-  // time counter
-  long int time;
-  
-  comedi_cmd comediCommand;
-  
-  /**
-   * file descriptor for /dev/comedi0
-   **/
-  comedi_t *dev;
-  size_t   readSize;
-  bool     sigmaBoard;
-  lsampl_t maxdata;
+  // where the data comes from, owned by the window
+  SampleSource *source;
   comedi_range* crange;
   double sampling_rate;
 
   int numChannels;
-  unsigned *chanlist;
-
-  int linearAverage;
 
-  Iir::Butterworth::BandStop<IIRORDER>* iirnotch;
+  // streams the raw data to disk while "record raw" is on
+  RecordingWriter *recorder;
+  // scans dropped by recorders which have been closed
+  long int recorderDropped;
+
+  // PSTH time axis in ms, the PSTHs themselves live in the processor
+  double *timeData;
+
+  // drains the ring and replots the raw data
+  int frameTimer;
+  // set when the raw data plot has to be replotted without new data
+  bool rawDirty;
+  // scans processed since the last replot of the raw data
+  int undrawn;
+  // seconds between replots of the raw data and time of the last one
+  double replotPeriod;
+  double lastReplot;
+
+  // scans travel from the acquisition thread to the GUI through here
+  SampleRing *sampleRing;
+  AcquisitionThread *acquisition;
+
+  // spike detection and PSTH/VEP for all channels
+  PsthProcessor *processor;
+  // smoothed rate of the train which is shown
+  SmoothedRate *smoothedRate;
+  // spectrum of the channel which is shown, on its own thread
+  SpectrumAnalyser *spectrum;
+
+  // shares the scans and spikes with other processes, 0 if not
+  LivePublisher *publisher;
+  // per train the earliest spike time not published yet
+  uint64_t *publishFrom;
+  // processor time after the last published block
+  long int publishedTime;
+
+  // timings of the whole pipeline, always on
+  PipelineStats *stats;
+  QLabel *statsLabel;
+  // scans and time at the last update of the panel
+  uint64_t statsScans;
+  double statsTime;
 
   QComboBox *averagePsth;
+  QwtCounter *cntSLength;
   QwtCounter *cntBinw;
   QTextEdit *editSpikeT;
   QPushButton *triggerPsth;
+  QPushButton *recordRaw;
+  // disabled while a .npz file is written
+  QPushButton *saveData;
   QCheckBox* filter50HzCheckBox;
+  QComboBox *notchFrequency;
+  // free running or the channel with the stimulus sync pulses
+  QComboBox *triggerSource;
+  // kernel of the smoothed rate
+  QComboBox *smoothing;
   QwtPlotMarker *thresholdMarker;
+  // all spikes of the channel or one of its units
+  QComboBox *unitSelect;
+  QLabel *sortLabel;
+
+  // ms to samples at the real sampling rate, at least one
+  int toSamples(double ms) const;
+  // hands the current PSTH buffers and time axis to the plot
+  void updatePsthPlot();
+  // counts the smoothed rate from the first trial again, after the
+  // trials or the bins have changed
+  void resetRate();
+  // passes the trigger settings on to the processor
+  void setTrigger();
+  // the same for the smoothing kernel
+  void setSmoothing();
+  // refreshes the statistics panel
+  void updateStats();
+  // train of the processor which is shown, the channel or a unit
+  int shownTrain() const;
+  // shows the number of templates of the channel
+  void updateSorting();
+  // hands a processed block and its new spikes to the publisher, time
+  // is that of the processor before the block
+  void publishBlock(const double *scans, int nScans, long int time);
+  // only spikes from time on are published from now
+  void restartEvents(long int time);
 
 private slots:
 
@@ -112,9 +191,21 @@ private slots:
   void slotSetChannel(double c);
   void slotSetPsthLength(double l);
   void slotSetPsthBinw(double b);
+  void slotTriggerSource(int idx);
+  void slotPreTrigger(double p);
+  void slotSmoothing(int idx);
+  void slotKernelWidth(double w);
   void slotSetSpikeThres();
   void slotSavePsth();
+  void slotRecord();
   void slotAveragePsth(int idx);
+  void slotFilter50Hz(int state);
+  void slotNotchFrequency(int idx);
+  void slotUpdatePsth();
+  void slotShowUnit(int idx);
+  void slotAddTemplate();
+  void slotClearTemplates();
+  void slotSaveTemplates();
 
 protected:
 
@@ -123,9 +214,22 @@ protected:
 
 public:
 
-  MainWindow( QWidget *parent=0 );
+  // takes ownership of the source and opens it
+  MainWindow( SampleSource *source, QWidget *parent=0 );
   ~MainWindow();
 
+  /// writes the pipeline statistics as JSON
+  bool saveStats(const char *filename);
+
+  /// replaces the spike sorting templates, see SpikeSorter
+  bool loadTemplates(const char *filename);
+
+  /// shares the live data through shared memory (see livestream.h)
+  bool publish(const char *name);
+
+  /// upper limit of the replots per second of both plots
+  void setFrameRate(double fps);
+
 };
 
 #endif
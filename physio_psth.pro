@@ -6,17 +6,66 @@ LIBS += \
     -L/usr/local/lib \
     -lqwt \
     -lcomedi \
+    -lrt \
     -liir
 
 TMAKE_CXXFLAGS += -fno-exceptions
 
 SOURCES = \
     psthplot.cpp \
+    rasterplot.cpp \
+    spectrumplot.cpp \
+    spectrumanalyser.cpp \
+    fft.cpp \
+    smoothedrate.cpp \
     dataplot.cpp \
     main.cpp \
-    physio_psth.cpp
+    physio_psth.cpp \
+    acquisitionthread.cpp \
+    comedisource.cpp \
+    multisource.cpp \
+    filesource.cpp \
+    syntheticsource.cpp \
+    samplesource.cpp \
+    recordingwriter.cpp \
+    livepublisher.cpp \
+    batch.cpp \
+    spikedetector.cpp \
+    spikesorter.cpp \
+    notchfilter.cpp \
+    psthprocessor.cpp \
+    psthexporter.cpp \
+    npzwriter.cpp \
+    pipelinestats.cpp \
+    bench.cpp
 
 HEADERS = \
     physio_psth.h \
     psthplot.h \
-    dataplot.h
+    rasterplot.h \
+    spectrumplot.h \
+    spectrumanalyser.h \
+    fft.h \
+    smoothedrate.h \
+    dataplot.h \
+    samplering.h \
+    acquisitionthread.h \
+    samplesource.h \
+    comedisource.h \
+    multisource.h \
+    filesource.h \
+    syntheticsource.h \
+    recording.h \
+    recordingwriter.h \
+    livestream.h \
+    livepublisher.h \
+    batch.h \
+    spikearena.h \
+    spikedetector.h \
+    spikesorter.h \
+    notchfilter.h \
+    psthprocessor.h \
+    psthexporter.h \
+    npzwriter.h \
+    pipelinestats.h \
+    bench.h
@@ -0,0 +1,194 @@
+/***************************************************************************
+ *   Copyright (C) 2003 by Matthias H. Hennig                              *
+ *   hennig@cn.stir.ac.uk                                                  *
+ *   Copyright (C) 2005 by Bernd Porr                                      *
+ *   mail@berndporr.me.uk                                                  *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#include "pipelinestats.h"
+
+#include <stdio.h>
+
+StageHistogram::StageHistogram() :
+    n(0),
+    sum(0),
+    max(0)
+{
+  for(int b=0; b<STATS_BUCKETS; b++)
+    buckets[b].storeRelease(0);
+}
+
+void StageHistogram::add(int64_t ns)
+{
+  if( ns < 0 )
+    ns = 0;
+  uint64_t v = ns;
+
+  // the top STATS_SUB_BITS bits below the leading one pick the bucket
+  int b;
+  if( v < STATS_SUB )
+    b = (int)v;
+  else
+  {
+    int shift = 63 - __builtin_clzll(v) - STATS_SUB_BITS;
+    b = (shift + 1) * STATS_SUB + (int)((v >> shift) & (STATS_SUB - 1));
+    if( b >= STATS_BUCKETS )
+      b = STATS_BUCKETS - 1;
+  }
+
+  // one writer, so nobody else changes them in between
+  buckets[b].storeRelease(buckets[b].loadAcquire() + 1);
+  n.storeRelease(n.loadAcquire() + 1);
+  sum.storeRelease(sum.loadAcquire() + v);
+  if( v > max.loadAcquire() )
+    max.storeRelease(v);
+}
+
+uint64_t StageHistogram::lowerBound(int b)
+{
+  if( b < STATS_SUB )
+    return b;
+  int shift = b / STATS_SUB - 1;
+  return (uint64_t)(STATS_SUB + b % STATS_SUB) << shift;
+}
+
+uint64_t StageHistogram::percentile(double p) const
+{
+  uint64_t c = count();
+  if( c == 0 )
+    return 0;
+
+  uint64_t want = (uint64_t)(p * c);
+  uint64_t seen = 0;
+  for(int b=0; b<STATS_BUCKETS; b++)
+  {
+    seen += bucket(b);
+    if( seen > want )
+      return b + 1 < STATS_BUCKETS ? lowerBound(b + 1) : maximum();
+  }
+  return maximum();
+}
+
+PipelineStats::PipelineStats() :
+    startTime(now()),
+    stampHead(0),
+    stampTail(0),
+    nArrived(0),
+    nDisplayed(0),
+    peakBytes(0),
+    deviceBufferSize(0),
+    lostRing(0),
+    lostRecorder(0)
+{
+}
+
+void PipelineStats::arrived(int nScans, int64_t t)
+{
+  uint64_t end = nArrived.loadAcquire() + nScans;
+  nArrived.storeRelease(end);
+
+  // the latency of this block is lost if the GUI is far behind
+  int h = stampHead.loadAcquire();
+  if( h - stampTail.loadAcquire() == STATS_STAMPS )
+    return;
+  stampEnd[h % STATS_STAMPS] = end;
+  stampTime[h % STATS_STAMPS] = t;
+  stampHead.storeRelease(h + 1);
+}
+
+void PipelineStats::displayed(int nScans)
+{
+  nDisplayed += nScans;
+
+  // every block which is now completely on the screen
+  int64_t t = now();
+  int tail = stampTail.loadAcquire();
+  int h = stampHead.loadAcquire();
+  while( tail != h && stampEnd[tail % STATS_STAMPS] <= nDisplayed )
+  {
+    record(STAGE_LATENCY, t - stampTime[tail % STATS_STAMPS]);
+    tail++;
+  }
+  stampTail.storeRelease(tail);
+}
+
+void PipelineStats::bufferLevel(int bytes, int size)
+{
+  deviceBufferSize.storeRelease(size);
+  if( bytes > peakBytes.loadAcquire() )
+    peakBytes.storeRelease(bytes);
+}
+
+void PipelineStats::setLost(long int ringOverruns, long int recorderDropped)
+{
+  lostRing = ringOverruns;
+  lostRecorder = recorderDropped;
+}
+
+const char *PipelineStats::stageName(int stage)
+{
+  static const char *names[NUM_STAGES] = {
+    "read", "decode", "filter", "detect", "accumulate", "render", "latency"
+  };
+  return names[stage];
+}
+
+bool PipelineStats::save(const char *filename) const
+{
+  FILE *f = fopen(filename, "w");
+  if( !f )
+  {
+    perror(filename);
+    return false;
+  }
+
+  double seconds = elapsed();
+  fprintf(f, "{\n");
+  fprintf(f, "  \"seconds\": %g,\n", seconds);
+  fprintf(f, "  \"scans\": %llu,\n", (unsigned long long)scansArrived());
+  fprintf(f, "  \"scans_per_second\": %g,\n",
+	  seconds > 0 ? scansArrived() / seconds : 0);
+  fprintf(f, "  \"ring_overruns\": %ld,\n", lostRing);
+  fprintf(f, "  \"recorder_dropped\": %ld,\n", lostRecorder);
+  fprintf(f, "  \"buffer_peak_bytes\": %d,\n", bufferPeak());
+  fprintf(f, "  \"buffer_size_bytes\": %d,\n", bufferSize());
+  fprintf(f, "  \"stages\": {\n");
+
+  for(int s=0; s<NUM_STAGES; s++)
+  {
+    const StageHistogram &h = stages[s];
+    uint64_t c = h.count();
+    fprintf(f, "    \"%s\": {\n", stageName(s));
+    fprintf(f, "      \"count\": %llu,\n", (unsigned long long)c);
+    fprintf(f, "      \"mean_ns\": %g,\n", c ? (double)h.total() / c : 0);
+    fprintf(f, "      \"p50_ns\": %llu,\n", (unsigned long long)h.percentile(0.5));
+    fprintf(f, "      \"p99_ns\": %llu,\n", (unsigned long long)h.percentile(0.99));
+    fprintf(f, "      \"max_ns\": %llu,\n", (unsigned long long)h.maximum());
+
+    // only the buckets in use, as [lower bound in ns, count]
+    fprintf(f, "      \"buckets\": [");
+    bool first = true;
+    for(int b=0; b<STATS_BUCKETS; b++)
+    {
+      uint64_t n = h.bucket(b);
+      if( !n )
+	continue;
+      fprintf(f, "%s[%llu, %llu]", first ? "" : ", ",
+	      (unsigned long long)StageHistogram::lowerBound(b),
+	      (unsigned long long)n);
+      first = false;
+    }
+    fprintf(f, "]\n");
+    fprintf(f, "    }%s\n", s + 1 < NUM_STAGES ? "," : "");
+  }
+
+  fprintf(f, "  }\n");
+  fprintf(f, "}\n");
+
+  return fclose(f) == 0;
+}
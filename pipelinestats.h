@@ -0,0 +1,145 @@
+/***************************************************************************
+ *   Copyright (C) 2003 by Matthias H. Hennig                              *
+ *   hennig@cn.stir.ac.uk                                                  *
+ *   Copyright (C) 2005 by Bernd Porr                                      *
+ *   mail@berndporr.me.uk                                                  *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#ifndef PIPELINESTATS_H
+#define PIPELINESTATS_H
+
+#include <QAtomicInt>
+#include <QAtomicInteger>
+
+#include <stdint.h>
+#include <time.h>
+
+// buckets per power of two of the histograms
+#define STATS_SUB_BITS 3
+#define STATS_SUB (1 << STATS_SUB_BITS)
+// up to 2^40ns, about 18 minutes
+#define STATS_BUCKETS (40 * STATS_SUB)
+
+// blocks whose latency can be pending at once
+#define STATS_STAMPS 1024
+
+enum PipelineStage
+{
+  STAGE_READ,
+  STAGE_DECODE,
+  STAGE_FILTER,
+  STAGE_DETECT,
+  STAGE_ACCUMULATE,
+  STAGE_RENDER,
+  // from the arrival of a block to the end of the replot showing it
+  STAGE_LATENCY,
+  NUM_STAGES
+};
+
+/**
+ * Histogram of durations in ns with STATS_SUB buckets per power of
+ * two, so any value is within 1/STATS_SUB of its bucket. Only one
+ * thread may add() to it, any thread may read it.
+ **/
+class StageHistogram
+{
+public:
+
+  StageHistogram();
+
+  void add(int64_t ns);
+
+  uint64_t count() const { return n.loadAcquire(); }
+  uint64_t total() const { return sum.loadAcquire(); }
+  uint64_t maximum() const { return max.loadAcquire(); }
+  uint64_t bucket(int b) const { return buckets[b].loadAcquire(); }
+
+  /// value below which the fraction p of the durations lies
+  uint64_t percentile(double p) const;
+
+  /// smallest duration which goes into bucket b
+  static uint64_t lowerBound(int b);
+
+private:
+
+  QAtomicInteger<uint64_t> buckets[STATS_BUCKETS];
+  QAtomicInteger<uint64_t> n;
+  QAtomicInteger<uint64_t> sum;
+  QAtomicInteger<uint64_t> max;
+};
+
+/**
+ * Timings of the stages of the pipeline from the device to the screen.
+ * The acquisition thread records read and decode, the buffer level of
+ * the device and when each block arrived; the GUI thread records the
+ * rest and when a block has been drawn. It costs a few clock reads per
+ * block, so it is always on.
+ **/
+class PipelineStats
+{
+public:
+
+  PipelineStats();
+
+  /// monotonic time in ns
+  static int64_t now()
+  {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+  }
+
+  void record(int stage, int64_t ns) { stages[stage].add(ns); }
+  const StageHistogram &stage(int stage) const { return stages[stage]; }
+
+  /// acquisition thread: nScans arrived at time t and are in the ring
+  void arrived(int nScans, int64_t t);
+  /// GUI thread: nScans more have been drawn
+  void displayed(int nScans);
+
+  /// acquisition thread: bytes waiting in the device buffer
+  void bufferLevel(int bytes, int size);
+  int bufferPeak() const { return peakBytes.loadAcquire(); }
+  int bufferSize() const { return deviceBufferSize.loadAcquire(); }
+
+  uint64_t scansArrived() const { return nArrived.loadAcquire(); }
+  /// seconds since the start
+  double elapsed() const { return (now() - startTime) * 1e-9; }
+
+  /// GUI thread: data thrown away by the ring or the recorder
+  void setLost(long int ringOverruns, long int recorderDropped);
+
+  /// writes everything as JSON, returns false on errors
+  bool save(const char *filename) const;
+
+  static const char *stageName(int stage);
+
+private:
+
+  StageHistogram stages[NUM_STAGES];
+  int64_t startTime;
+
+  // when the block ending at scan stampEnd arrived, written by the
+  // acquisition thread only
+  uint64_t stampEnd[STATS_STAMPS];
+  int64_t stampTime[STATS_STAMPS];
+  QAtomicInt stampHead;
+  QAtomicInt stampTail;
+
+  QAtomicInteger<uint64_t> nArrived;
+  // GUI thread only
+  uint64_t nDisplayed;
+
+  QAtomicInt peakBytes;
+  QAtomicInt deviceBufferSize;
+
+  long int lostRing;
+  long int lostRecorder;
+};
+
+#endif
@@ -0,0 +1,229 @@
+/***************************************************************************
+ *   Copyright (C) 2003 by Matthias H. Hennig                              *
+ *   hennig@cn.stir.ac.uk                                                  *
+ *   Copyright (C) 2005 by Bernd Porr                                      *
+ *   mail@berndporr.me.uk                                                  *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#include "psthexporter.h"
+#include "psthprocessor.h"
+#include "smoothedrate.h"
+
+#include <stdio.h>
+#include <string.h>
+
+PsthExporter::PsthExporter(const PsthProcessor *processor, const char *name) :
+    sem(0),
+    rate(0),
+    ok(0)
+{
+  filename = new char[strlen(name) + 1];
+  strcpy(filename, name);
+
+  nBins = processor->numBins();
+  samplingRate = processor->rate();
+  binSamples = processor->binSamples();
+  preTrigger = processor->preTriggerSamples();
+  sweepSamples = processor->sweepSamples();
+  average = processor->isAverage();
+  incomplete = processor->rebuilding();
+
+  int *t = new int[processor->numTrains()];
+  nTrains = processor->savedTrains(t);
+  trains = new int32_t[nTrains];
+  for(int k=0; k<nTrains; k++)
+    trains[k] = t[k];
+  delete[] t;
+
+  time = new double[nBins];
+  for(int i=0; i<nBins; i++)
+    time[i] = double(i * binSamples - preTrigger) * 1000 / samplingRate;
+
+  psth = new double[nTrains * nBins];
+  for(int k=0; k<nTrains; k++)
+    memcpy(psth + k * nBins, processor->psth(trains[k]), nBins * sizeof(double));
+
+  if( average )
+  {
+    sem = new double[nTrains * nBins];
+    for(int k=0; k<nTrains; k++)
+      for(int i=0; i<nBins; i++)
+	sem[k * nBins + i] = processor->standardError(trains[k], i);
+  }
+  else if( processor->smoothingKernel() != KERNEL_NONE )
+  {
+    rate = new double[nTrains * nBins];
+    for(int k=0; k<nTrains; k++)
+    {
+      SmoothedRate smoothed(processor, trains[k]);
+      smoothed.update();
+      for(int i=0; i<nBins; i++)
+	rate[k * nBins + i] = smoothed.at(i * binSamples + binSamples / 2);
+    }
+  }
+
+  nTrials = processor->runningTrial();
+  trialStarts = new int64_t[nTrials];
+  for(long int j=0; j<nTrials; j++)
+    trialStarts[j] = processor->trialStart(j);
+
+  // the blocks never move, so a copy of the pointers is a snapshot
+  nSpikes = new long int[nTrains];
+  blocks = new const uint64_t**[nTrains];
+  for(int k=0; k<nTrains; k++)
+  {
+    const SpikeArena &spikes = processor->spikes(trains[k]);
+    nSpikes[k] = spikes.size();
+    blocks[k] = new const uint64_t*[spikes.numBlocks()];
+    for(int b=0; b<spikes.numBlocks(); b++)
+      blocks[k][b] = spikes.block(b);
+  }
+}
+
+PsthExporter::~PsthExporter()
+{
+  wait();
+  for(int k=0; k<nTrains; k++)
+    delete[] blocks[k];
+  delete[] blocks;
+  delete[] nSpikes;
+  delete[] trialStarts;
+  delete[] rate;
+  delete[] sem;
+  delete[] psth;
+  delete[] time;
+  delete[] trains;
+  delete[] filename;
+}
+
+void PsthExporter::run()
+{
+  ok.storeRelease(write());
+}
+
+bool PsthExporter::write()
+{
+  if( incomplete )
+  {
+    fprintf(stderr, "%s: the PSTH is still being rebuilt\n", filename);
+    return false;
+  }
+
+  NpzWriter npz;
+  if( !npz.open(filename) )
+    return false;
+
+  long int shape[3] = { nTrains, nBins, 0 };
+  npz.array("trains", "<i4", shape, 1, trains, nTrains * sizeof(int32_t));
+  npz.array("time", "<f8", shape + 1, 1, time, nBins * sizeof(double));
+  npz.array("psth", "<f8", shape, 2, psth, nTrains * nBins * sizeof(double));
+  if( sem )
+    npz.array("sem", "<f8", shape, 2, sem, nTrains * nBins * sizeof(double));
+  if( rate )
+    npz.array("rate", "<f8", shape, 2, rate, nTrains * nBins * sizeof(double));
+  npz.array("trial_starts", "<i8", &nTrials, 1,
+	    trialStarts, nTrials * sizeof(int64_t));
+  if( !average )
+    writeTrialCounts(&npz);
+  writeSpikes(&npz);
+
+  npz.array("sampling_rate", "<f8", 0, 0, &samplingRate, sizeof(double));
+  int64_t v = binSamples;
+  npz.array("bin_samples", "<i8", 0, 0, &v, sizeof(v));
+  v = preTrigger;
+  npz.array("pre_trigger_samples", "<i8", 0, 0, &v, sizeof(v));
+  v = sweepSamples;
+  npz.array("sweep_samples", "<i8", 0, 0, &v, sizeof(v));
+
+  return npz.close();
+}
+
+bool PsthExporter::writeTrialCounts(NpzWriter *npz)
+{
+  long int shape[3] = { nTrains, nTrials, nBins };
+  if( !npz->begin("trial_counts", "<i4", shape, 3) )
+    return false;
+
+  // whole trials of counts, at least one
+  long int rows = EXPORT_CHUNK_EVENTS / nBins;
+  if( rows < 1 )
+    rows = 1;
+  int32_t *counts = new int32_t[rows * nBins];
+
+  bool good = true;
+  for(int k=0; good && k<nTrains; k++)
+  {
+    // both lists are sorted, the first spike of a trial only moves on
+    long int first = 0;
+    for(long int j=0; good && j<nTrials; j+=rows)
+    {
+      long int n = nTrials - j < rows ? nTrials - j : rows;
+      memset(counts, 0, n * nBins * sizeof(int32_t));
+      for(long int r=0; r<n; r++)
+      {
+	uint64_t start = trialStarts[j + r];
+	int32_t *row = counts + r * nBins;
+	while( first < nSpikes[k] && spike(k, first) < start )
+	  first++;
+	for(long int i=first; i<nSpikes[k]; i++)
+	{
+	  uint64_t offset = spike(k, i) - start;
+	  if( offset >= (uint64_t)sweepSamples )
+	    break;
+	  row[offset / binSamples]++;
+	}
+      }
+      good = npz->write(counts, n * nBins * sizeof(int32_t));
+    }
+  }
+  delete[] counts;
+
+  return good && npz->end();
+}
+
+bool PsthExporter::writeSpikes(NpzWriter *npz)
+{
+  long int total = 0;
+  for(int k=0; k<nTrains; k++)
+    total += nSpikes[k];
+
+  // straight from the blocks of the arenas
+  if( !npz->begin("spike_times", "<u8", &total, 1) )
+    return false;
+  for(int k=0; k<nTrains; k++)
+    for(long int i=0; i<nSpikes[k]; i+=SPIKE_BLOCK_EVENTS)
+    {
+      long int n = nSpikes[k] - i;
+      if( n > SPIKE_BLOCK_EVENTS )
+	n = SPIKE_BLOCK_EVENTS;
+      if( !npz->write(blocks[k][i / SPIKE_BLOCK_EVENTS], n * sizeof(uint64_t)) )
+	return false;
+    }
+  if( !npz->end() )
+    return false;
+
+  if( !npz->begin("spike_trains", "<i4", &total, 1) )
+    return false;
+  int32_t *train = new int32_t[EXPORT_CHUNK_EVENTS];
+  bool good = true;
+  for(int k=0; good && k<nTrains; k++)
+  {
+    for(int i=0; i<EXPORT_CHUNK_EVENTS; i++)
+      train[i] = trains[k];
+    for(long int i=0; good && i<nSpikes[k]; i+=EXPORT_CHUNK_EVENTS)
+    {
+      long int n = nSpikes[k] - i;
+      if( n > EXPORT_CHUNK_EVENTS )
+	n = EXPORT_CHUNK_EVENTS;
+      good = npz->write(train, n * sizeof(int32_t));
+    }
+  }
+  delete[] train;
+
+  return good && npz->end();
+}
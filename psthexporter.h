@@ -0,0 +1,110 @@
+/***************************************************************************
+ *   Copyright (C) 2003 by Matthias H. Hennig                              *
+ *   hennig@cn.stir.ac.uk                                                  *
+ *   Copyright (C) 2005 by Bernd Porr                                      *
+ *   mail@berndporr.me.uk                                                  *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#ifndef PSTHEXPORTER_H
+#define PSTHEXPORTER_H
+
+#include <stdint.h>
+
+#include <QThread>
+#include <QAtomicInt>
+
+#include "npzwriter.h"
+#include "spikearena.h"
+
+class PsthProcessor;
+
+// spike counts and spikes buffered before they are written
+#define EXPORT_CHUNK_EVENTS 65536
+
+/**
+ * Writes the results of a PsthProcessor as NumPy arrays into a .npz
+ * file, for every train saved (the channels and the units which have
+ * templates, as by PsthProcessor::save()):
+ *
+ *   trains        train numbers, see PsthProcessor::unitTrain()
+ *   time          start of each bin relative to the trigger in ms
+ *   psth          trains x bins, spikes/s or the VEP
+ *   sem           trains x bins, standard error of the VEP
+ *   rate          trains x bins, the smoothed rate at the bin centres
+ *   trial_starts  first sample of every completed trial
+ *   trial_counts  trains x trials x bins, spikes per trial and bin
+ *   spike_times   sample of every spike, train after train
+ *   spike_trains  train of every spike
+ *
+ * and the scalars sampling_rate, bin_samples, pre_trigger_samples and
+ * sweep_samples. sem only comes with the VEP, rate only with a
+ * smoothing kernel and the trial counts only with the PSTH.
+ *
+ * The small arrays are copied by the constructor, the spikes are read
+ * from a copy of the block pointers of their SpikeArenas (which never
+ * move), so the processor carries on while the file is written. It
+ * must not clear the spikes before the export has finished. While the
+ * PSTH is being rebuilt it is all zeros, write() fails then.
+ **/
+class PsthExporter : public QThread
+{
+public:
+
+  PsthExporter(const PsthProcessor *processor, const char *filename);
+  ~PsthExporter();
+
+  /// writes the file on the calling thread, false on error
+  bool write();
+
+  /// valid once the thread has finished
+  bool succeeded() const { return ok.loadAcquire() != 0; }
+
+protected:
+
+  virtual void run();
+
+private:
+
+  uint64_t spike(int k, long int i) const
+  {
+    return blocks[k][i / SPIKE_BLOCK_EVENTS][i % SPIKE_BLOCK_EVENTS];
+  }
+
+  bool writeTrialCounts(NpzWriter *npz);
+  bool writeSpikes(NpzWriter *npz);
+
+  char *filename;
+
+  int nTrains;
+  int nBins;
+  double samplingRate;
+  long int binSamples;
+  long int preTrigger;
+  long int sweepSamples;
+  bool average;
+  // the processor was rebuilding the PSTH
+  bool incomplete;
+
+  int32_t *trains;
+  double *time;
+  double *psth;
+  // 0 if there are none
+  double *sem;
+  double *rate;
+
+  long int nTrials;
+  int64_t *trialStarts;
+
+  // per train: number of spikes and the blocks holding them
+  long int *nSpikes;
+  const uint64_t ***blocks;
+
+  QAtomicInt ok;
+};
+
+#endif
@@ -15,7 +15,10 @@
 PsthPlot::PsthPlot(double *xData, double *yData, int length, QWidget *parent) :
     QwtPlot(parent),
     xData(xData),
-    yData(yData)
+    yData(yData),
+    semData(0),
+    currtimer(0),
+    interval(1000 / PSTH_FRAME_RATE)
 {
   // Assign a title
   setTitle("PSTH");
@@ -28,10 +31,26 @@ PsthPlot::PsthPlot(double *xData, double *yData, int length, QWidget *parent) :
   dataCurve->setPen( QPen(Qt::blue, 2) );
   dataCurve->setStyle(QwtPlotCurve::Steps);
 
+  semBand = new QwtPlotIntervalCurve("SEM");
+  semBand->setPen( QPen(Qt::NoPen) );
+  semBand->setBrush( QColor(0, 0, 255, 60) );
+  semBand->setZ(dataCurve->z() - 1);
+  semBand->attach(this);
+  semBand->hide();
+
+  rateCurve = new QwtPlotCurve("rate");
+  rateCurve->setPen( QPen(Qt::red, 2) );
+  rateCurve->attach(this);
+  rateCurve->hide();
+  rateData = 0;
+  nRatePoints = 0;
+  rateDirty = false;
+
   max = 0;
   min = 0;
   nDatapoints = length;
-  updateCtr = 1;
+  dirtyFirst = 0;
+  dirtyLast = length - 1;
 
   setAutoReplot(false);
 }
@@ -40,33 +59,124 @@ void PsthPlot::setPsthLength(int length)
 {
 	nDatapoints = length;	
 	dataCurve->setRawSamples(xData, yData, length);
+	setAllDirty();
+}
+
+void PsthPlot::setPsthData(double *y)
+{
+	yData = y;
+	dataCurve->setRawSamples(xData, yData, nDatapoints);
+	setAllDirty();
+}
+
+void PsthPlot::setTimeData(double *x)
+{
+	xData = x;
+	dataCurve->setRawSamples(xData, yData, nDatapoints);
+	setAllDirty();
+}
+
+void PsthPlot::setSemData(double *sem)
+{
+	semData = sem;
+	semBand->setVisible(sem != 0);
+	if( !sem )
+		semBand->setSamples(QVector<QwtIntervalSample>());
+	setAllDirty();
+}
+
+void PsthPlot::setRateData(const double *x, const double *y, int length)
+{
+	rateData = y;
+	nRatePoints = y ? length : 0;
+	rateCurve->setVisible(y != 0);
+	rateCurve->setRawSamples(x, y, nRatePoints);
+	setAllDirty();
 }
 
 void PsthPlot::startDisplay()
 {
-	currtimer=startTimer(150);
+	if (!currtimer)
+		currtimer=startTimer(interval);
 }
 
 void PsthPlot::stopDisplay()
 {
-	killTimer(currtimer);
+	if (currtimer)
+		killTimer(currtimer);
+	currtimer = 0;
+}
+
+void PsthPlot::setFrameRate(double fps)
+{
+	interval = fps > 0 ? (int)(1000 / fps) : 1000;
+	if (currtimer) {
+		stopDisplay();
+		startDisplay();
+	}
+}
+
+void PsthPlot::setDirty(int first, int last)
+{
+	if (first < dirtyFirst)
+		dirtyFirst = first;
+	if (last > dirtyLast)
+		dirtyLast = last;
 }
 
 void PsthPlot::timerEvent(QTimerEvent *)
 {
-	updateCtr--;
-	if (updateCtr==0) {
-		min = INT_MAX;
-		max = INT_MIN;
-		for(int i=0;i<nDatapoints;i++) {
-			float y = yData[i];
-			if (y>max) max = y;
-			if (y<min) min = y;
-		}
+	emit aboutToReplot();
+	refresh();
+}
+
+void PsthPlot::refresh()
+{
+	if (dirtyLast >= nDatapoints)
+		dirtyLast = nDatapoints - 1;
+	// a new rate changes the scale, which is then worked out again
+	if (rateDirty)
+		setAllDirty();
+	if (dirtyFirst > dirtyLast || !yData)
+		return;
+	rateDirty = false;
+
+	if (semData && band.size() != nDatapoints) {
+		band.resize(nDatapoints);
+		setAllDirty();
+	}
+	bool all = dirtyFirst == 0 && dirtyLast == nDatapoints - 1;
+
+	if (semData) {
+		for(int i=dirtyFirst;i<=dirtyLast;i++)
+			band[i] = QwtIntervalSample(xData[i], yData[i]-semData[i],
+						    yData[i]+semData[i]);
+		semBand->setSamples(band);
+	}
+
+	// all bins have to be scanned to shrink the range, only the
+	// changed ones to grow it
+	double newMin = all ? INT_MAX : min;
+	double newMax = all ? INT_MIN : max;
+	for(int i=dirtyFirst;i<=dirtyLast;i++) {
+		double e = semData ? semData[i] : 0;
+		double y = yData[i];
+		if (y+e>newMax) newMax = y+e;
+		if (y-e<newMin) newMin = y-e;
+	}
+	for(int i=0;i<nRatePoints;i++) {
+		if (rateData[i]>newMax) newMax = rateData[i];
+		if (rateData[i]<newMin) newMin = rateData[i];
+	}
+	if (newMin != min || newMax != max) {
+		min = newMin;
+		max = newMax;
 		double d = max - min;
 		setAxisScale(QwtPlot::yLeft,min-d/10,max+d/10);
-		updateCtr = 10;
 	}
 
-  replot();
+	dirtyFirst = nDatapoints;
+	dirtyLast = -1;
+
+	replot();
 }
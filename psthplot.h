@@ -13,39 +13,87 @@
 
 #include <qwt/qwt_plot.h>
 #include <qwt/qwt_plot_curve.h>
+#include <qwt/qwt_plot_intervalcurve.h>
 
 #include <QTimerEvent>
+#include <QVector>
 
-/** The PSTH plot widget
+// default upper limit of the replots per second
+#define PSTH_FRAME_RATE 10
+
+/** The PSTH plot widget. It is only replotted when bins have changed,
+ * at most at the frame rate.
 */
 class PsthPlot : public QwtPlot
 {
+  Q_OBJECT
+
   ///pointer to the curve widget
   QwtPlotCurve *dataCurve;
+  /// +/- standard error around the curve
+  QwtPlotIntervalCurve *semBand;
+  /// smoothed rate over the bins
+  QwtPlotCurve *rateCurve;
 
   // pointer to the x and y data
   double *xData, *yData;
+  // standard error of yData, 0 if there is none
+  double *semData;
   
   // PSTH curve
   long cPsthData;
-  ///timer id
+  ///timer id, 0 if the display is stopped
   int currtimer;
+  // ms between two replots
+  int interval;
 
+  // autoscale bounds of the curve (+/- sem)
   double max,min;
-  int updateCtr;
+
+  // smoothed rate, 0 if there is none, and whether it has changed
+  const double *rateData;
+  int nRatePoints;
+  bool rateDirty;
 
   int nDatapoints;
 
+  // bins changed since the last replot, none if dirtyFirst > dirtyLast
+  int dirtyFirst, dirtyLast;
+
+  // the band is kept and only changed where the data changed
+  QVector<QwtIntervalSample> band;
+
+  void setAllDirty() { setDirty(0, nDatapoints - 1); }
+
 protected:
-  // replot the data regularly
+  // replot the data if it has changed
   virtual void timerEvent(QTimerEvent *e);
 
 public:
   PsthPlot(double *xData, double *yData, int length, QWidget *parent = 0);
   void setPsthLength(int length);
+  void setPsthData(double *yData);
+  void setTimeData(double *xData);
+  // shows yData +/- sem as a band, 0 switches it off
+  void setSemData(double *sem);
+  // shows a smoothed rate as a line over the bins, 0 switches it off
+  void setRateData(const double *x, const double *y, int length);
+  /// the smoothed rate has new values
+  void setRateDirty() { rateDirty = true; }
   void startDisplay();
   void stopDisplay();
+  // upper limit of the replots per second while the display runs
+  void setFrameRate(double fps);
+  /// bins first to last have new values
+  void setDirty(int first, int last);
+  /// replots now if anything has changed
+  void refresh();
   void setYaxisLabel(const QString &label) { setAxisTitle(QwtPlot::yLeft, label); }
+
+signals:
+  /// emitted on every frame, so the changed bins can be passed on with
+  /// setDirty() before the plot decides whether to replot
+  void aboutToReplot();
 };
 
 #endif
@@ -0,0 +1,942 @@
+/***************************************************************************
+ *   Copyright (C) 2003 by Matthias H. Hennig                              *
+ *   hennig@cn.stir.ac.uk                                                  *
+ *   Copyright (C) 2005 by Bernd Porr                                      *
+ *   mail@berndporr.me.uk                                                  *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#include "psthprocessor.h"
+#include "psthexporter.h"
+#include "spikedetector.h"
+#include "smoothedrate.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// zeroed and aligned to a cache line
+static double *newBuffer(size_t n)
+{
+  void *p;
+  if( posix_memalign(&p, 64, (n ? n : 1) * sizeof(double)) != 0 )
+  {
+    fprintf(stderr, "out of memory\n");
+    abort();
+  }
+  memset(p, 0, n * sizeof(double));
+  return (double *)p;
+}
+
+PsthProcessor::PsthProcessor(int numChannels, double samplingRate) :
+    nChannels(numChannels),
+    nTrains(numChannels * (1 + SORT_MAX_UNITS)),
+    samplingRate(samplingRate),
+    psthLength(1000),
+    psthBinw(20),
+    nBins(0),
+    spikeThres(1),
+    filterOn(false),
+    linearAverage(false),
+    psthOn(false),
+    psthActTrial(0),
+    time(0),
+    nRow(0),
+    rebuilder(0),
+    exporter(0),
+    triggerCh(-1),
+    triggerLevel(TRIGGER_LEVEL),
+    preTrigger(0),
+    triggerDetected(false),
+    firstOpen(0),
+    history(0),
+    histLen(0),
+    kernel(KERNEL_NONE),
+    kernelWidth(1),
+    stats(0),
+    detectTime(0)
+{
+  rows = newBuffer(nChannels * PROC_BLOCK_SCANS);
+  spikeDetected = new bool[nChannels];
+  dirtyFirst = new int[nTrains];
+  dirtyLast = new int[nTrains];
+  // nothing changed yet, allocate() marks everything
+  for(int c=0; c<nTrains; c++)
+  {
+    dirtyFirst[c] = nBins;
+    dirtyLast[c] = -1;
+  }
+  slots = new int[nTrains];
+  slotTrains = new int[nTrains];
+  nSlots = 0;
+  spikeCountData = 0;
+  psthData = 0;
+  vepM2 = 0;
+  semData = 0;
+  arenas = new SpikeArena[nTrains];
+  spikeSorter = new SpikeSorter(nChannels, samplingRate, PROC_BLOCK_SCANS);
+
+  notch = new NotchFilterBank(nChannels, samplingRate);
+  filtered = newBuffer(nChannels * PROC_BLOCK_SCANS);
+  history = newBuffer(0);
+
+  allocate();
+  clear();
+}
+
+PsthProcessor::~PsthProcessor()
+{
+  cancelRebuild();
+  delete exporter;
+  delete[] arenas;
+  delete spikeSorter;
+  delete notch;
+  free(filtered);
+  free(history);
+  free(psthData);
+  free(vepM2);
+  free(semData);
+  free(spikeCountData);
+  delete[] spikeDetected;
+  delete[] dirtyFirst;
+  delete[] dirtyLast;
+  delete[] slots;
+  delete[] slotTrains;
+  free(rows);
+}
+
+void PsthProcessor::clear()
+{
+  cancelRebuild();
+  finishExport();
+  for(int c=0; c<nTrains; c++)
+    arenas[c].clear();
+  size_t n = (size_t)(nSlots + 1) * nBins;
+  memset(psthData, 0, n * sizeof(double));
+  if( linearAverage )
+  {
+    memset(vepM2, 0, n * sizeof(double));
+    memset(semData, 0, n * sizeof(double));
+  }
+  else
+    memset(spikeCountData, 0, n * sizeof(double));
+  spikeSorter->reset();
+  for(int c=0; c<nChannels; c++)
+    spikeDetected[c] = false;
+  trialStarts.clear();
+  firstOpen = 0;
+  triggerDetected = false;
+  memset(history, 0, nChannels * histLen * sizeof(double));
+  psthActTrial = 0;
+  time = 0;
+  markAllDirty();
+}
+
+void PsthProcessor::markAllDirty()
+{
+  for(int c=0; c<nTrains; c++)
+    markDirty(c, 0, nBins - 1);
+}
+
+bool PsthProcessor::takeDirty(int channel, int *first, int *last)
+{
+  *first = dirtyFirst[channel];
+  *last = dirtyLast[channel];
+  dirtyFirst[channel] = nBins;
+  dirtyLast[channel] = -1;
+  if( *last >= nBins )
+    *last = nBins - 1;
+  return *first <= *last;
+}
+
+void PsthProcessor::allocate()
+{
+  // the rebuild counts into bins of the old size
+  cancelRebuild();
+
+  if( linearAverage )
+    nBins = psthLength;
+  else
+    nBins = (psthLength + psthBinw - 1) / psthBinw;
+
+  // the channels, then the units of the channels with templates, the
+  // VEP has no units
+  nSlots = 0;
+  for(int c=0; c<nChannels; c++)
+    slotTrains[nSlots++] = c;
+  if( !linearAverage )
+    for(int c=0; c<nChannels; c++)
+      for(int u=0; u<spikeSorter->numUnits(c); u++)
+	slotTrains[nSlots++] = unitTrain(c, u);
+  for(int t=0; t<nTrains; t++)
+    slots[t] = nSlots;
+  for(int k=0; k<nSlots; k++)
+    slots[slotTrains[k]] = k;
+
+  free(spikeCountData);
+  free(psthData);
+  free(vepM2);
+  free(semData);
+
+  // and the row of zeros
+  size_t n = (size_t)(nSlots + 1) * nBins;
+  psthData = newBuffer(n);
+  spikeCountData = linearAverage ? 0 : newBuffer(n);
+  vepM2 = linearAverage ? newBuffer(n) : 0;
+  semData = linearAverage ? newBuffer(n) : 0;
+
+  // ranges of the old size mean nothing now
+  for(int c=0; c<nTrains; c++)
+  {
+    dirtyFirst[c] = nBins;
+    dirtyLast[c] = -1;
+  }
+  markAllDirty();
+}
+
+double PsthProcessor::bufferBytes(int length, int binw, bool average) const
+{
+  // the mean, squared deviations and standard error of the channels
+  if( average )
+    return 3.0 * (nChannels + 1) * length * sizeof(double);
+  // the counts and rates of all trains
+  return 2.0 * (nTrains + 1) * ((length + binw - 1) / binw) * sizeof(double);
+}
+
+bool PsthProcessor::setPsthLength(int length)
+{
+  if( bufferBytes(length, psthBinw, linearAverage) > PROC_MAX_BUFFER_BYTES )
+    return false;
+  psthLength = length;
+  allocate();
+  if( linearAverage )
+  {
+    clear();
+    return true;
+  }
+  if( triggerCh >= 0 )
+  {
+    // trials which had ended may be running again
+    firstOpen = 0;
+    updateOpenTrials();
+    psthActTrial = trialStarts.size();
+  }
+  else
+    psthActTrial = (time + psthLength - 1) / psthLength;
+  rebuild();
+  return true;
+}
+
+bool PsthProcessor::setBinWidth(int binw)
+{
+  if( bufferBytes(psthLength, binw, linearAverage) > PROC_MAX_BUFFER_BYTES )
+    return false;
+  psthBinw = binw;
+  // the VEP has one bin per sample
+  if( linearAverage )
+    return true;
+  allocate();
+  rebuild();
+  return true;
+}
+
+bool PsthProcessor::setAverage(bool on)
+{
+  if( on == linearAverage )
+    return true;
+  if( bufferBytes(psthLength, psthBinw, on) > PROC_MAX_BUFFER_BYTES )
+    return false;
+  linearAverage = on;
+  allocate();
+  if( linearAverage )
+    clear();
+  else
+    rebuild();
+  return true;
+}
+
+void PsthProcessor::setTrigger(int channel, double level, int pre)
+{
+  if( channel >= nChannels )
+    channel = -1;
+  triggerCh = channel;
+  triggerLevel = level;
+  preTrigger = pre < 0 ? 0 : pre;
+
+  // the trigger comes after the first samples of its trial
+  free(history);
+  histLen = triggerCh >= 0 ? preTrigger + PROC_BLOCK_SCANS : 0;
+  history = newBuffer((size_t)nChannels * histLen);
+
+  clear();
+}
+
+void PsthProcessor::setSmoothing(SmoothingKernel k, double width)
+{
+  kernel = k;
+  kernelWidth = width;
+}
+
+long int PsthProcessor::numTrials() const
+{
+  if( triggerCh >= 0 )
+    return trialStarts.size();
+  return time / psthLength + 1;
+}
+
+long int PsthProcessor::runningTrial() const
+{
+  if( triggerCh >= 0 )
+    return firstOpen;
+  return time / psthLength;
+}
+
+void PsthProcessor::updateOpenTrials()
+{
+  long int n = trialStarts.size();
+  while( firstOpen < n &&
+	 (long int)trialStarts[firstOpen] + psthLength <= time )
+    firstOpen++;
+}
+
+void PsthProcessor::rebuild()
+{
+  cancelRebuild();
+
+  // spikes from now on are counted live with the new parameters and
+  // the old ones are added when the rebuild is done
+  memset(spikeCountData, 0, nSlots * nBins * sizeof(double));
+  memset(psthData, 0, nSlots * nBins * sizeof(double));
+  markAllDirty();
+
+  long int nEvents = 0;
+  for(int k=0; k<nSlots; k++)
+    nEvents += arenas[slotTrains[k]].size();
+  if( nEvents == 0 )
+    return;
+
+  rebuilder = new PsthRebuilder(arenas, slotTrains, nSlots, psthLength,
+				psthBinw, nBins,
+				triggerCh >= 0 ? &trialStarts : 0);
+  rebuilder->start();
+}
+
+bool PsthProcessor::mergeRebuild()
+{
+  if( !rebuilder || !rebuilder->isFinished() )
+    return false;
+
+  const double *counts = rebuilder->counts();
+  for(size_t i=0; i<(size_t)nSlots * nBins; i++)
+    spikeCountData[i] += counts[i];
+
+  delete rebuilder;
+  rebuilder = 0;
+
+  long int nTrials = numTrials();
+  if( nTrials > 0 )
+    for(int k=0; k<nSlots; k++)
+      normalise(slotTrains[k], nTrials);
+  return true;
+}
+
+void PsthProcessor::finishRebuild()
+{
+  if( !rebuilder )
+    return;
+  rebuilder->wait();
+  mergeRebuild();
+}
+
+void PsthProcessor::cancelRebuild()
+{
+  if( !rebuilder )
+    return;
+  rebuilder->abort();
+  rebuilder->wait();
+  delete rebuilder;
+  rebuilder = 0;
+}
+
+void PsthProcessor::normalise(int channel, long int nTrials)
+{
+  const double *spikeCount = spikeCountData + binOffset(channel);
+  double *psth = psthData + binOffset(channel);
+
+  for(int i=0; i<nBins; i++)
+    psth[i] = ( spikeCount[i]*samplingRate ) / ( binWidth(i) * nTrials );
+  markDirty(channel, 0, nBins - 1);
+}
+
+int PsthProcessor::addTemplate(int channel, const double *shape, double tolerance)
+{
+  int unit = spikeSorter->addTemplate(channel, shape, tolerance);
+  if( unit != UNIT_REJECTED )
+    clearUnits(channel);
+  return unit;
+}
+
+void PsthProcessor::clearTemplates(int channel)
+{
+  spikeSorter->clearTemplates(channel);
+  clearUnits(channel);
+}
+
+bool PsthProcessor::loadTemplates(const char *filename)
+{
+  bool ok = spikeSorter->loadTemplates(filename);
+  clearUnits(-1);
+  return ok;
+}
+
+void PsthProcessor::clearUnits(int channel)
+{
+  // the spikes would be sorted differently now
+  cancelRebuild();
+  finishExport();
+  for(int c=0; c<nChannels; c++)
+    if( channel < 0 || c == channel )
+      for(int u=0; u<SORT_MAX_UNITS; u++)
+        arenas[unitTrain(c, u)].clear();
+  // the VEP has no spikes
+  if( linearAverage )
+    return;
+  // the units with bins have changed
+  allocate();
+  rebuild();
+}
+
+void PsthProcessor::setThreshold(double thres)
+{
+  spikeThres = thres;
+  for(int c=0; c<nChannels; c++)
+    spikeDetected[c] = false;
+}
+
+void PsthProcessor::start()
+{
+  clear();
+  psthOn = true;
+}
+
+void PsthProcessor::stop()
+{
+  psthOn = false;
+  psthActTrial = 0;
+  for(int c=0; c<nChannels; c++)
+    spikeDetected[c] = false;
+}
+
+int PsthProcessor::process(const double *scans, int nScans)
+{
+  mergeRebuild();
+
+  if( nScans > PROC_BLOCK_SCANS )
+    nScans = PROC_BLOCK_SCANS;
+  nRow = nScans;
+  if( nScans == 0 )
+    return 0;
+
+  // the sync pulses are taken before the filter, which would make them
+  // ring and move their edges
+  if( triggerCh >= 0 )
+    for(int n=0; n<nScans; n++)
+      triggerRow[n] = scans[n*nChannels + triggerCh];
+
+  // the channels of a scan are next to each other, so they are
+  // filtered together before the transposition
+  int64_t t0 = PipelineStats::now();
+  if( filterOn )
+  {
+    notch->process(scans, filtered, nScans);
+    scans = filtered;
+  }
+  int64_t t1 = PipelineStats::now();
+
+  // transpose the scans into one contiguous row per channel
+  for(int n=0; n<nScans; n++)
+    for(int c=0; c<nChannels; c++)
+      rows[c*PROC_BLOCK_SCANS + n] = scans[n*nChannels + c];
+
+  // the transposition counts as part of the detection
+  int64_t t2 = PipelineStats::now();
+  detectTime = t2 - t1;
+
+  // the clock only runs while recording, so that the trials are the
+  // ones which were recorded
+  if( !psthOn )
+  {
+    recordTimes(t0, t1, t2);
+    return nScans;
+  }
+
+  if( triggerCh >= 0 )
+  {
+    processTriggered(nScans);
+    time += nScans;
+    updateOpenTrials();
+    psthActTrial = trialStarts.size();
+    recordTimes(t0, t1, t2);
+    return nScans;
+  }
+
+  int firstIndex = time % psthLength;
+  long int firstTrial = time / psthLength;
+
+  long int lastTrial = firstTrial + (firstIndex + nScans) / psthLength;
+
+  for(int c=0; c<nChannels; c++)
+  {
+    const double *y = rows + c*PROC_BLOCK_SCANS;
+    double *psth = psthData + binOffset(c);
+
+    if( linearAverage )
+    {
+      // Welford's running mean and squared deviations, every offset
+      // gets its (trial+1)th sample in this trial
+      double *m2 = vepM2 + binOffset(c);
+      int trialIndex = firstIndex;
+      long int trial = firstTrial;
+      double invN = 1.0 / (trial + 1);
+
+      for(int n=0; n<nScans; n++)
+      {
+        double delta = y[n] - psth[trialIndex];
+        psth[trialIndex] += delta * invN;
+        m2[trialIndex] += delta * (y[n] - psth[trialIndex]);
+
+        if( ++trialIndex == psthLength )
+        {
+          trialIndex = 0;
+          trial++;
+          invN = 1.0 / (trial + 1);
+        }
+      }
+      if( firstIndex + nScans > psthLength )
+        markDirty(c, 0, nBins - 1);
+      else
+        markDirty(c, firstIndex, firstIndex + nScans - 1);
+      continue;
+    }
+
+    double *spikeCount = spikeCountData + binOffset(c);
+    int64_t t = PipelineStats::now();
+    int nSpikes = detectCrossings(y, nScans, spikeThres,
+				  &spikeDetected[c], crossings);
+    detectTime += PipelineStats::now() - t;
+
+    for(int k=0; k<nSpikes; k++)
+    {
+      int n = crossings[k];
+      int trialIndex = (firstIndex + n) % psthLength;
+      long int trial = firstTrial + (firstIndex + n) / psthLength;
+      int psthIndex = trialIndex / psthBinw;
+
+      spikeCount[psthIndex] += 1;
+
+      psth[psthIndex] = ( spikeCount[psthIndex]*samplingRate ) /
+	      ( binWidth(psthIndex) * (trial + 1) );
+      markDirty(c, psthIndex, psthIndex);
+
+      arenas[c].append(time + n);
+    }
+
+    sortSpikes(c, nSpikes, (time + nScans - 1) / psthLength + 1);
+
+    // all bins share the number of trials
+    if( lastTrial != firstTrial )
+    {
+      normalise(c, lastTrial + 1);
+      for(int u=0; u<spikeSorter->numUnits(c); u++)
+        normalise(unitTrain(c, u), lastTrial + 1);
+    }
+  }
+
+  // a new trial starts each time the trial index passes zero
+  psthActTrial += (firstIndex + nScans - 1) / psthLength + (firstIndex == 0);
+  time += nScans;
+
+  recordTimes(t0, t1, t2);
+  return nScans;
+}
+
+void PsthProcessor::recordTimes(int64_t t0, int64_t t1, int64_t t2)
+{
+  if( !stats )
+    return;
+
+  if( filterOn )
+    stats->record(STAGE_FILTER, t1 - t0);
+  stats->record(STAGE_DETECT, detectTime);
+  // everything after the transposition which was not detection
+  stats->record(STAGE_ACCUMULATE, PipelineStats::now() - t2 -
+		(detectTime - (t2 - t1)));
+}
+
+void PsthProcessor::countSpike(int channel, int bin, long int nTrials)
+{
+  double *spikeCount = spikeCountData + binOffset(channel);
+  spikeCount[bin] += 1;
+  psthData[binOffset(channel) + bin] = ( spikeCount[bin]*samplingRate ) /
+    ( binWidth(bin) * nTrials );
+  markDirty(channel, bin, bin);
+}
+
+void PsthProcessor::processTriggered(int nScans)
+{
+  // the trigger edges are found like spikes, one block at a time
+  int64_t detectStart = PipelineStats::now();
+  int nEdges = detectCrossings(triggerRow, nScans,
+			       triggerLevel, &triggerDetected, edges);
+  detectTime += PipelineStats::now() - detectStart;
+
+  // trials before firstOpen have ended, up to nOld they were running
+  // already, the rest starts in this block
+  long int nOld = trialStarts.size();
+  for(int k=0; k<nEdges; k++)
+  {
+    long int start = time + edges[k] - preTrigger;
+    // not enough data before the first trigger
+    if( start >= 0 )
+      trialStarts.append(start);
+  }
+  long int nTrials = trialStarts.size();
+  long int end = time + nScans;
+
+  for(int c=0; c<nChannels; c++)
+  {
+    const double *y = rows + c*PROC_BLOCK_SCANS;
+    double *psth = psthData + binOffset(c);
+
+    if( linearAverage )
+    {
+      double *h = history + c*histLen;
+      double *m2 = vepM2 + binOffset(c);
+      for(int n=0; n<nScans; n++)
+        h[(time + n) % histLen] = y[n];
+
+      // in the order of the trials, so every offset gets the samples
+      // of trial j as its (j+1)th
+      for(long int j=firstOpen; j<nTrials; j++)
+      {
+        long int start = trialStarts[j];
+        long int from = j < nOld ? time : start;
+        long int to = start + psthLength;
+        if( to > end )
+          to = end;
+        double invN = 1.0 / (j + 1);
+
+        for(long int s=from; s<to; s++)
+        {
+          double v = h[s % histLen];
+          int i = s - start;
+          double delta = v - psth[i];
+          psth[i] += delta * invN;
+          m2[i] += delta * (v - psth[i]);
+        }
+        if( from < to )
+          markDirty(c, from - start, to - start - 1);
+      }
+      continue;
+    }
+
+    detectStart = PipelineStats::now();
+    int nSpikes = detectCrossings(y, nScans, spikeThres,
+				  &spikeDetected[c], crossings);
+    detectTime += PipelineStats::now() - detectStart;
+
+    // new spikes in the trials which were running already
+    for(int k=0; k<nSpikes; k++)
+    {
+      long int spike = time + crossings[k];
+      arenas[c].append(spike);
+      for(long int j=firstOpen; j<nOld; j++)
+      {
+        long int offset = spike - (long int)trialStarts[j];
+        if( offset < psthLength )
+          countSpike(c, offset / psthBinw, nTrials);
+      }
+    }
+
+    countEarlierSpikes(c, nOld, nTrials);
+
+    // the units get their spikes late, when the snippet is complete
+    for(int u=0; u<spikeSorter->numUnits(c); u++)
+      countEarlierSpikes(unitTrain(c, u), nOld, nTrials);
+    sortSpikes(c, nSpikes, nTrials);
+
+    // a new trial changes the rate of every bin
+    if( nTrials != nOld )
+    {
+      normalise(c, nTrials);
+      for(int u=0; u<spikeSorter->numUnits(c); u++)
+        normalise(unitTrain(c, u), nTrials);
+    }
+  }
+}
+
+void PsthProcessor::countEarlierSpikes(int train, long int first, long int nTrials)
+{
+  // going back from the latest spike in the arena
+  for(long int j=first; j<nTrials; j++)
+  {
+    long int start = trialStarts[j];
+    for(long int i=arenas[train].size()-1; i>=0; i--)
+    {
+      long int offset = (long int)arenas[train][i] - start;
+      if( offset < 0 )
+        break;
+      if( offset < psthLength )
+        countSpike(train, offset / psthBinw, nTrials);
+    }
+  }
+}
+
+void PsthProcessor::sortSpikes(int channel, int nSpikes, long int nTrials)
+{
+  int n = spikeSorter->process(channel, rows + channel*PROC_BLOCK_SCANS, nRow,
+			       crossings, nSpikes, time);
+  const long int *t = spikeSorter->sortedTimes();
+  const int *unit = spikeSorter->sortedUnits();
+
+  for(int k=0; k<n; k++)
+  {
+    if( unit[k] == UNIT_REJECTED )
+      continue;
+    int train = unitTrain(channel, unit[k]);
+    arenas[train].append(t[k]);
+
+    if( triggerCh < 0 )
+    {
+      countSpike(train, (t[k] % psthLength) / psthBinw, nTrials);
+      continue;
+    }
+
+    // the spike may be in trials which have ended since, or which
+    // started after it
+    for(long int j=trialStarts.lowerBound(t[k] + 1) - 1; j>=0; j--)
+    {
+      long int offset = t[k] - (long int)trialStarts[j];
+      if( offset >= psthLength )
+        break;
+      countSpike(train, offset / psthBinw, nTrials);
+    }
+  }
+}
+
+bool PsthProcessor::saveNpz(const char *filename)
+{
+  finishRebuild();
+  PsthExporter e(this, filename);
+  return e.write();
+}
+
+bool PsthProcessor::startExport(const char *filename)
+{
+  if( exporter && !exporter->isFinished() )
+    return false;
+  // the exporter copies the PSTHs, which are zero during a rebuild
+  finishRebuild();
+  // a result nobody asked for
+  delete exporter;
+  exporter = new PsthExporter(this, filename);
+  exporter->start();
+  return true;
+}
+
+bool PsthProcessor::takeExport(bool *ok)
+{
+  if( !exporter || !exporter->isFinished() )
+    return false;
+  *ok = exporter->succeeded();
+  delete exporter;
+  exporter = 0;
+  return true;
+}
+
+void PsthProcessor::finishExport()
+{
+  // the result is still collected by takeExport()
+  if( exporter )
+    exporter->wait();
+}
+
+PsthRebuilder::PsthRebuilder(const SpikeArena *arenas, const int *trains,
+			     int numTrains, int psthLength, int psthBinw,
+			     int nBins, const SpikeArena *trialStarts) :
+    nTrains(numTrains),
+    psthLength(psthLength),
+    psthBinw(psthBinw),
+    nBins(nBins),
+    nStarts(0),
+    startBlocks(0),
+    aborted(0)
+{
+  // the blocks never move, so a copy of the pointers is a snapshot
+  nEvents = new long int[nTrains];
+  blocks = new const uint64_t**[nTrains];
+  for(int c=0; c<nTrains; c++)
+  {
+    const SpikeArena &arena = arenas[trains[c]];
+    nEvents[c] = arena.size();
+    blocks[c] = new const uint64_t*[arena.numBlocks()];
+    for(int b=0; b<arena.numBlocks(); b++)
+      blocks[c][b] = arena.block(b);
+  }
+  if( trialStarts )
+  {
+    nStarts = trialStarts->size();
+    startBlocks = new const uint64_t*[trialStarts->numBlocks()];
+    for(int b=0; b<trialStarts->numBlocks(); b++)
+      startBlocks[b] = trialStarts->block(b);
+  }
+  spikeCount = new double[(size_t)nTrains * nBins];
+}
+
+PsthRebuilder::~PsthRebuilder()
+{
+  for(int c=0; c<nTrains; c++)
+    delete[] blocks[c];
+  delete[] blocks;
+  delete[] startBlocks;
+  delete[] nEvents;
+  delete[] spikeCount;
+}
+
+void PsthRebuilder::run()
+{
+  memset(spikeCount, 0, (size_t)nTrains * nBins * sizeof(double));
+
+  for(int c=0; c<nTrains; c++)
+  {
+    double *count = spikeCount + c*nBins;
+    // first trial which has not ended before the current spike
+    long int first = 0;
+
+    for(long int i=0; i<nEvents[c]; i+=SPIKE_BLOCK_EVENTS)
+    {
+      if( aborted.loadAcquire() )
+        return;
+
+      const uint64_t *t = blocks[c][i / SPIKE_BLOCK_EVENTS];
+      long int n = nEvents[c] - i;
+      if( n > SPIKE_BLOCK_EVENTS )
+        n = SPIKE_BLOCK_EVENTS;
+
+      if( !startBlocks )
+      {
+        for(long int k=0; k<n; k++)
+          count[(t[k] % psthLength) / psthBinw] += 1;
+        continue;
+      }
+
+      // both lists are sorted, so the trials of a spike are a window
+      // which only moves forward
+      for(long int k=0; k<n; k++)
+      {
+        long int tk = t[k];
+        while( first < nStarts && trialStart(first) + psthLength <= tk )
+          first++;
+        for(long int j=first; j<nStarts && trialStart(j) <= tk; j++)
+          count[(tk - trialStart(j)) / psthBinw] += 1;
+      }
+    }
+  }
+}
+
+double PsthProcessor::standardError(int channel, int index) const
+{
+  long int n;
+  if( triggerCh >= 0 )
+  {
+    // ended trials have all offsets, running ones those up to now
+    n = firstOpen;
+    for(long int j=firstOpen; j<trialStarts.size(); j++)
+      if( (long int)trialStarts[j] + index < time )
+        n++;
+  }
+  else
+    // the offsets before the current one have one sample more
+    n = time / psthLength + (index < time % psthLength);
+  if( n < 2 )
+    return 0;
+  return sqrt(vepM2[binOffset(channel) + index] / (n - 1) / n);
+}
+
+void PsthProcessor::updateSem(int channel, int first, int last)
+{
+  // the row of zeros stays zero
+  if( !linearAverage || slots[channel] == nSlots )
+    return;
+
+  double *s = sem(channel);
+  for(int i=first; i<=last && i<nBins; i++)
+    s[i] = standardError(channel, i);
+}
+
+int PsthProcessor::savedTrains(int *trains) const
+{
+  int n = 0;
+  for(int c=0; c<nChannels; c++)
+    trains[n++] = c;
+  // the VEP has no units
+  if( !linearAverage )
+    for(int c=0; c<nChannels; c++)
+      for(int u=0; u<spikeSorter->numUnits(c); u++)
+        trains[n++] = unitTrain(c, u);
+  return n;
+}
+
+bool PsthProcessor::save(const char *filename)
+{
+  finishRebuild();
+
+  FILE *f = fopen(filename, "w");
+  if( !f )
+  {
+    perror(filename);
+    return false;
+  }
+
+  int *trains = new int[nTrains];
+  int n = savedTrains(trains);
+
+  SmoothedRate **smoothed = new SmoothedRate*[n];
+  for(int k=0; k<n; k++)
+  {
+    smoothed[k] = 0;
+    if( kernel != KERNEL_NONE && !linearAverage )
+    {
+      smoothed[k] = new SmoothedRate(this, trains[k]);
+      smoothed[k]->update();
+    }
+  }
+
+  // time axis in ms, relative to the trigger
+  for(int i=0; i<nBins; i++)
+  {
+    fprintf(f, "%g", double(i*binSamples() - preTriggerSamples())*1000/samplingRate);
+    for(int k=0; k<n; k++)
+    {
+      fprintf(f, "\t%g", psth(trains[k])[i]);
+      // the VEP gets its standard error next to it
+      if( linearAverage )
+        fprintf(f, "\t%g", standardError(trains[k], i));
+      if( smoothed[k] )
+        fprintf(f, "\t%g", smoothed[k]->at(i*psthBinw + psthBinw/2));
+    }
+    fprintf(f, "\n");
+  }
+
+  for(int k=0; k<n; k++)
+    delete smoothed[k];
+  delete[] smoothed;
+  delete[] trains;
+
+  return fclose(f) == 0;
+}
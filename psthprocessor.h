@@ -0,0 +1,390 @@
+/***************************************************************************
+ *   Copyright (C) 2003 by Matthias H. Hennig                              *
+ *   hennig@cn.stir.ac.uk                                                  *
+ *   Copyright (C) 2005 by Bernd Porr                                      *
+ *   mail@berndporr.me.uk                                                  *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#ifndef PSTHPROCESSOR_H
+#define PSTHPROCESSOR_H
+
+#include <QThread>
+#include <QAtomicInt>
+
+#include "spikearena.h"
+#include "notchfilter.h"
+#include "pipelinestats.h"
+#include "spikesorter.h"
+
+class PsthExporter;
+
+// number of scans processed in one go
+#define PROC_BLOCK_SCANS 256
+
+// default trigger level in V, half way up a TTL pulse
+#define TRIGGER_LEVEL 2.5
+
+// upper limit of the PSTH/VEP buffers in bytes, longer sweeps are
+// refused
+#define PROC_MAX_BUFFER_BYTES (1024.0 * 1024 * 1024)
+
+// kernels for the smoothed rate, see SmoothedRate
+enum SmoothingKernel
+{
+  KERNEL_NONE,
+  KERNEL_GAUSSIAN,
+  // causal, only spikes before a point count
+  KERNEL_EXPONENTIAL
+};
+
+/**
+ * Counts the spikes of a snapshot of the SpikeArenas into PSTH bins on
+ * its own thread. With trial start times every spike is counted in
+ * each trial it falls into, otherwise a new trial starts every
+ * psthLength samples.
+ **/
+class PsthRebuilder : public QThread
+{
+public:
+
+  // counts the arenas of numTrains trains, in the order given
+  PsthRebuilder(const SpikeArena *arenas, const int *trains, int numTrains,
+		int psthLength, int psthBinw, int nBins,
+		const SpikeArena *trialStarts = 0);
+  ~PsthRebuilder();
+
+  /// makes run() return early, the result is useless then
+  void abort() { aborted.storeRelease(1); }
+
+  /// nBins spike counts per train
+  const double *counts() const { return spikeCount; }
+
+protected:
+
+  virtual void run();
+
+private:
+
+  long int trialStart(long int j) const
+  {
+    return startBlocks[j / SPIKE_BLOCK_EVENTS][j % SPIKE_BLOCK_EVENTS];
+  }
+
+  int nTrains;
+  int psthLength;
+  int psthBinw;
+  int nBins;
+
+  // per train: number of events and the blocks holding them
+  long int *nEvents;
+  const uint64_t ***blocks;
+
+  // trial starts, none when free running
+  long int nStarts;
+  const uint64_t **startBlocks;
+
+  double *spikeCount;
+
+  QAtomicInt aborted;
+};
+
+/**
+ * Filtering, spike detection and PSTH/VEP accumulation for all channels
+ * at once. Scans arrive interleaved (one double per channel), are
+ * transposed into one contiguous row per channel and every row is then
+ * run through the detector. All per channel state lives in flat arrays
+ * indexed by channel.
+ *
+ * The spikes are also sorted into units by a SpikeSorter, each unit
+ * gets its own PSTH. The spike times are kept per spike train: one per
+ * channel with all its spikes, followed by SORT_MAX_UNITS per channel
+ * for the units. Only the channels and the units which have templates
+ * get PSTH bins, the others share a row of zeros.
+ **/
+class PsthProcessor
+{
+public:
+
+  PsthProcessor(int numChannels, double samplingRate);
+  ~PsthProcessor();
+
+  int numChannels() const { return nChannels; }
+
+  // length and bin width are in samples. Changing them rebuilds the
+  // PSTH from the spike times in the background, the VEP has to be
+  // cleared when the length changes. The PSTH/VEP buffers are
+  // reallocated, so pointers from psth() and sem() become invalid.
+  // Returns false and keeps the old value if the buffers would be
+  // larger than PROC_MAX_BUFFER_BYTES. The last bin is shorter if the
+  // length is not a multiple of the bin width.
+  bool setPsthLength(int length);
+  bool setBinWidth(int binw);
+  void setThreshold(double thres);
+  void setFilter(bool on) { filterOn = on; }
+  // mains frequency for the filter, 50 or 60Hz
+  void setNotchFrequency(double f) { notch->setFrequency(f); }
+  double notchFrequency() const { return notch->frequency(); }
+  // VEP instead of PSTH, the VEP starts from scratch. False if its
+  // buffers would be too large, as above.
+  bool setAverage(bool on);
+  // trials start pre samples before an upward crossing of level on the
+  // trigger channel instead of every psthLength samples, -1 runs
+  // free. Starts from scratch.
+  void setTrigger(int channel, double level, int pre);
+  int triggerChannel() const { return triggerCh; }
+  /// samples before the trigger at the start of each trial
+  int preTriggerSamples() const { return triggerCh >= 0 ? preTrigger : 0; }
+
+  /// spike trains, the channels and then their units. psth(), sem(),
+  /// spikes(), takeDirty() and updateSem() take either.
+  int numTrains() const { return nTrains; }
+  int unitTrain(int channel, int unit) const
+  {
+    return nChannels + channel*SORT_MAX_UNITS + unit;
+  }
+
+  /// snippets and templates of all channels
+  const SpikeSorter *sorter() const { return spikeSorter; }
+  // changing the templates of a channel clears the PSTHs of its units
+  int addTemplate(int channel, const double *shape, double tolerance);
+  void clearTemplates(int channel);
+  // replaces the templates of all channels
+  bool loadTemplates(const char *filename);
+
+  // kernel of the smoothed rate next to the PSTH, width is the sigma
+  // of the Gaussian or the time constant of the exponential in samples
+  void setSmoothing(SmoothingKernel kernel, double width);
+  SmoothingKernel smoothingKernel() const { return kernel; }
+  double smoothingWidth() const { return kernelWidth; }
+
+  /// filter, detect and accumulate timings go here, 0 for none
+  void setStats(PipelineStats *s) { stats = s; }
+
+  void start();
+  void stop();
+  bool isOn() const { return psthOn; }
+  /// true for the VEP
+  bool isAverage() const { return linearAverage; }
+  void clear();
+
+  /// processes up to PROC_BLOCK_SCANS interleaved scans and returns
+  /// how many were used
+  int process(const double *scans, int nScans);
+
+  /// (filtered) samples of the last processed block for one channel
+  const double *row(int channel) const { return rows + channel*PROC_BLOCK_SCANS; }
+  int rowLength() const { return nRow; }
+
+  double rate() const { return samplingRate; }
+
+  /// number of PSTH bins, or samples of the VEP, per channel
+  int numBins() const { return nBins; }
+  /// samples per bin
+  int binSamples() const { return linearAverage ? 1 : psthBinw; }
+
+  /// spikes/s or averaged data for one channel
+  double *psth(int channel) { return psthData + binOffset(channel); }
+  const double *psth(int channel) const { return psthData + binOffset(channel); }
+
+  /// standard error of the VEP, valid after updateSem()
+  double *sem(int channel) { return semData + binOffset(channel); }
+  /// standard error of one sample offset of the VEP
+  double standardError(int channel, int index) const;
+
+  /// computes the standard error of bins first to last of one channel
+  /// from the running sums, only needed when it is shown
+  void updateSem(int channel, int first, int last);
+
+  /// the range of bins of one channel which changed since the last
+  /// call, returns false if none did
+  bool takeDirty(int channel, int *first, int *last);
+
+  int trials() const { return psthActTrial; }
+
+  /// trials seen so far, including the ones still running
+  long int numTrials() const;
+  /// first trial which is still running, the ones before are complete
+  long int runningTrial() const;
+  /// start of trial k in samples, as the spike times
+  long int trialStart(long int k) const
+  {
+    return triggerCh >= 0 ? (long int)trialStarts[k] : k * psthLength;
+  }
+  /// length of a trial in samples
+  int sweepSamples() const { return psthLength; }
+
+  /// spike times of one channel since start()
+  const SpikeArena &spikes(int channel) const { return arenas[channel]; }
+  /// samples processed while on since the last clear(), the clock of
+  /// the spikes and trials
+  long int samples() const { return time; }
+
+  /// true while the PSTH is being rebuilt in the background
+  bool rebuilding() const { return rebuilder != 0; }
+  /// adds the result of a finished rebuild to the live counts, true if
+  /// there was one. process() does this, without new data it has to
+  /// be polled.
+  bool mergeRebuild();
+  /// waits for the rebuild and merges it
+  void finishRebuild();
+
+  /// writes the time axis and one column per channel as ASCII, then
+  /// one per unit of the channels with templates. With a smoothing
+  /// kernel every PSTH column is followed by the smoothed rate at the
+  /// centre of the bin. A rebuild is finished first. Returns false if
+  /// the file could not be written
+  bool save(const char *filename);
+
+  /// the trains which are saved: the channels and then the units of
+  /// every channel which has templates, returns how many
+  int savedTrains(int *trains) const;
+
+  /// writes the PSTHs, the spikes per trial and all spike times as a
+  /// NumPy .npz file, see PsthExporter. A rebuild is finished first.
+  bool saveNpz(const char *filename);
+  /// the same on a background thread, false if one is still running
+  bool startExport(const char *filename);
+  /// true once when the export has finished, with its result in ok
+  bool takeExport(bool *ok);
+
+private:
+
+  // sizes the PSTH/VEP buffers for the current parameters and
+  // templates
+  void allocate();
+  // start of the bins of a train in the buffers below
+  size_t binOffset(int train) const { return (size_t)slots[train] * nBins; }
+  // bytes of the buffers for these parameters, with room for the units
+  // of every channel
+  double bufferBytes(int length, int binw, bool average) const;
+  // samples in a PSTH bin, the last one may be short
+  int binWidth(int bin) const
+  {
+    int w = psthLength - bin * psthBinw;
+    return w < psthBinw ? w : psthBinw;
+  }
+  // recounts all spikes with the current parameters
+  void rebuild();
+  void cancelRebuild();
+  // waits for the export, the spikes are about to be cleared
+  void finishExport();
+  // recomputes spikes/s of one channel from its counts
+  void normalise(int channel, long int nTrials);
+  // bins first to last of one channel have changed
+  void markDirty(int channel, int first, int last)
+  {
+    if( first < dirtyFirst[channel] )
+      dirtyFirst[channel] = first;
+    if( last > dirtyLast[channel] )
+      dirtyLast[channel] = last;
+  }
+  void markAllDirty();
+  // spikes or VEP of one block in trigger mode
+  void processTriggered(int nScans);
+  // adds one spike to a bin
+  void countSpike(int channel, int bin, long int nTrials);
+  // counts the spikes of a train from before trials first to nTrials-1
+  // in trigger mode
+  void countEarlierSpikes(int train, long int first, long int nTrials);
+  // sorts the crossings of the last block of a channel and counts the
+  // spikes of the snippets which are complete now
+  void sortSpikes(int channel, int nSpikes, long int nTrials);
+  // clears the units of a channel, or of all with -1
+  void clearUnits(int channel);
+  // the trials still running at the end of the last block start here
+  void updateOpenTrials();
+  // hands the timings of one block to stats, t0-t1 was the filter and
+  // the transposition ended at t2
+  void recordTimes(int64_t t0, int64_t t1, int64_t t2);
+
+  int nChannels;
+  // channels and units
+  int nTrains;
+  double samplingRate;
+
+  int psthLength;
+  int psthBinw;
+  // length of one channel in the buffers below
+  int nBins;
+  double spikeThres;
+  bool filterOn;
+  bool linearAverage;
+  bool psthOn;
+
+  // count trials while recording
+  int psthActTrial;
+  // time counter in samples
+  long int time;
+
+  // one row of PROC_BLOCK_SCANS samples per channel
+  double *rows;
+  int nRow;
+
+  // sample indices of the spikes found in one row
+  int crossings[PROC_BLOCK_SCANS];
+
+  // per channel: set when a spike is detected and the activity has
+  // not gone back to resting potential
+  bool *spikeDetected;
+  // per train: its row in the buffers below, nSlots for the row of
+  // zeros of the trains without bins
+  int *slots;
+  // the trains with bins, in the order of their rows
+  int *slotTrains;
+  int nSlots;
+  // per row: nBins bins each, the counts only for the PSTH
+  double *spikeCountData;
+  double *psthData;
+
+  // VEP only: the running mean is kept in psthData (Welford), this
+  // holds the summed squared deviations per sample offset
+  double *vepM2;
+  double *semData;
+
+  // per train: bins changed since takeDirty(), empty if first > last
+  int *dirtyFirst;
+  int *dirtyLast;
+
+  // per train: every spike since start()
+  SpikeArena *arenas;
+  SpikeSorter *spikeSorter;
+  PsthRebuilder *rebuilder;
+  // writes a .npz file in the background, 0 if none
+  PsthExporter *exporter;
+
+  // trigger mode
+  int triggerCh;
+  double triggerLevel;
+  int preTrigger;
+  bool triggerDetected;
+  // the trigger channel of the last block, unfiltered
+  double triggerRow[PROC_BLOCK_SCANS];
+  int edges[PROC_BLOCK_SCANS];
+  // start of every trial in samples, pre samples before its trigger
+  SpikeArena trialStarts;
+  // first trial which still gets samples
+  long int firstOpen;
+  // per channel: the last histLen samples, indexed by time % histLen,
+  // so that a VEP trial can start before its trigger
+  double *history;
+  int histLen;
+
+  SmoothingKernel kernel;
+  double kernelWidth;
+
+  // 50Hz or 60Hz mains notch filter for all channels
+  NotchFilterBank *notch;
+  // filtered scans, interleaved like the input
+  double *filtered;
+
+  PipelineStats *stats;
+  // time spent in the detector in the current block
+  int64_t detectTime;
+};
+
+#endif
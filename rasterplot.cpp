@@ -0,0 +1,147 @@
+/***************************************************************************
+ *   Copyright (C) 2003 by Matthias H. Hennig                              *
+ *   hennig@cn.stir.ac.uk                                                  *
+ *   Copyright (C) 2005 by Bernd Porr                                      *
+ *   mail@berndporr.me.uk                                                  *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#include "rasterplot.h"
+
+#include <QPainter>
+
+void RasterItem::draw(QPainter *painter,
+		      const QwtScaleMap &, const QwtScaleMap &,
+		      const QRectF &canvasRect) const
+{
+  if( !image->isNull() )
+    painter->drawImage(canvasRect, *image);
+}
+
+RasterPlot::RasterPlot(const PsthProcessor *processor, QWidget *parent) :
+    QwtPlot(parent),
+    processor(processor),
+    channel(0),
+    capacity(RASTER_MIN_TRIALS),
+    painted(0),
+    lastTrials(-1),
+    lastSpikes(-1)
+{
+  setTitle("Raster");
+  setAxisTitle(QwtPlot::xBottom, "Time/ms");
+  setAxisTitle(QwtPlot::yLeft, "Trial");
+
+  item = new RasterItem(&image);
+  item->attach(this);
+
+  setAutoReplot(false);
+  updateAxes();
+}
+
+void RasterPlot::setChannel(int c)
+{
+  channel = c;
+  reset();
+}
+
+void RasterPlot::resizeEvent(QResizeEvent *e)
+{
+  QwtPlot::resizeEvent(e);
+  reset();
+}
+
+void RasterPlot::updateAxes()
+{
+  double ms = 1000 / processor->rate();
+  int pre = processor->preTriggerSamples();
+  setAxisScale(QwtPlot::xBottom, -pre * ms,
+	       (processor->sweepSamples() - pre) * ms);
+  // the first trial at the top
+  setAxisScale(QwtPlot::yLeft, capacity, 0);
+}
+
+void RasterPlot::reset()
+{
+  QSize size = canvas()->contentsRect().size();
+  if( image.size() != size )
+    image = QImage(size, QImage::Format_RGB32);
+  image.fill(qRgb(255, 255, 255));
+
+  capacity = RASTER_MIN_TRIALS;
+  while( capacity < processor->numTrials() )
+    capacity *= 2;
+  painted = 0;
+  lastTrials = -1;
+  lastSpikes = -1;
+
+  updateAxes();
+  refresh();
+}
+
+void RasterPlot::paintTrials(long int first, long int last)
+{
+  const SpikeArena &spikes = processor->spikes(channel);
+  long int length = processor->sweepSamples();
+  int w = image.width();
+  int h = image.height();
+  QRgb tick = qRgb(0, 0, 255);
+
+  for(long int k=first; k<last; k++)
+  {
+    int y0 = (int)(k * h / capacity);
+    int y1 = (int)((k + 1) * h / capacity);
+    // a gap between rows which are high enough
+    if( y1 - y0 > 2 )
+      y1--;
+    if( y1 <= y0 )
+      y1 = y0 + 1;
+    if( y1 > h )
+      y1 = h;
+
+    long int start = processor->trialStart(k);
+    for(long int i=spikes.lowerBound(start); i<spikes.size(); i++)
+    {
+      long int offset = (long int)spikes[i] - start;
+      if( offset >= length )
+	break;
+      int x = (int)(offset * w / length);
+      for(int y=y0; y<y1; y++)
+	((QRgb *)image.scanLine(y))[x] = tick;
+    }
+  }
+}
+
+void RasterPlot::refresh()
+{
+  if( image.isNull() )
+    return;
+
+  long int nTrials = processor->numTrials();
+  long int nSpikes = processor->spikes(channel).size();
+  if( nTrials == lastTrials && nSpikes == lastSpikes )
+    return;
+
+  if( nTrials > capacity )
+  {
+    // the rows get thinner, so all of them are painted again
+    while( capacity < nTrials )
+      capacity *= 2;
+    image.fill(qRgb(255, 255, 255));
+    painted = 0;
+    updateAxes();
+  }
+
+  // ticks are only ever added, so running trials can be painted again
+  paintTrials(painted, nTrials);
+  painted = processor->runningTrial();
+  if( painted > nTrials )
+    painted = nTrials;
+
+  lastTrials = nTrials;
+  lastSpikes = nSpikes;
+  replot();
+}
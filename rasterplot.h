@@ -0,0 +1,90 @@
+/***************************************************************************
+ *   Copyright (C) 2003 by Matthias H. Hennig                              *
+ *   hennig@cn.stir.ac.uk                                                  *
+ *   Copyright (C) 2005 by Bernd Porr                                      *
+ *   mail@berndporr.me.uk                                                  *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#ifndef RASTERPLOT_H
+#define RASTERPLOT_H
+
+#include <qwt/qwt_plot.h>
+#include <qwt/qwt_plot_item.h>
+
+#include <QImage>
+#include <QResizeEvent>
+
+#include "psthprocessor.h"
+
+// rows the raster starts with, doubled whenever the trials do not fit
+#define RASTER_MIN_TRIALS 16
+
+/// draws a finished image over the whole canvas
+class RasterItem : public QwtPlotItem
+{
+public:
+
+  RasterItem(const QImage *image) : image(image) {}
+
+  virtual int rtti() const { return QwtPlotItem::Rtti_PlotUserItem; }
+  virtual void draw(QPainter *painter,
+		    const QwtScaleMap &xMap, const QwtScaleMap &yMap,
+		    const QRectF &canvasRect) const;
+
+private:
+
+  const QImage *image;
+};
+
+/**
+ * One row per trial and a tick per spike of one channel. The spikes
+ * are read from the processor's spike times and painted into an image
+ * of the size of the canvas: new trials, and the ones still running,
+ * are added row by row, everything is only painted again when the
+ * rows run out (their number doubles then), on a resize or a reset().
+ **/
+class RasterPlot : public QwtPlot
+{
+public:
+
+  RasterPlot(const PsthProcessor *processor, QWidget *parent = 0);
+
+  void setChannel(int c);
+
+  /// paints everything again, after the spikes or the sweep changed
+  void reset();
+
+  /// paints the new spikes and replots if there were any
+  void refresh();
+
+protected:
+
+  virtual void resizeEvent(QResizeEvent *e);
+
+private:
+
+  // paints trials first to last-1 into the image
+  void paintTrials(long int first, long int last);
+  void updateAxes();
+
+  const PsthProcessor *processor;
+  int channel;
+
+  QImage image;
+  RasterItem *item;
+
+  // number of rows of the image
+  long int capacity;
+  // trials before this one are complete and painted
+  long int painted;
+  // trials and spikes at the last refresh()
+  long int lastTrials;
+  long int lastSpikes;
+};
+
+#endif
@@ -0,0 +1,69 @@
+/***************************************************************************
+ *   Copyright (C) 2003 by Matthias H. Hennig                              *
+ *   hennig@cn.stir.ac.uk                                                  *
+ *   Copyright (C) 2005 by Bernd Porr                                      *
+ *   mail@berndporr.me.uk                                                  *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#ifndef RECORDING_H
+#define RECORDING_H
+
+#include <stdint.h>
+
+/*
+ * Layout of a raw data recording (all little endian, as written by
+ * the PC):
+ *
+ *   RecordingHeader
+ *   RecordingChunk + chunk.nScans raw scans     (repeated)
+ *   uint64_t number of chunks                   (optional index,
+ *   RecordingIndexEntry per chunk                at header.indexOffset)
+ *
+ * A scan holds header.numChannels samples of header.sampleSize bytes,
+ * i.e. exactly what the comedi device delivered. The samples are
+ * converted to physical units with comedi_to_phys() and the range and
+ * maxdata stored in the header.
+ */
+
+#define RECORDING_MAGIC "PSTHRAW1"
+#define RECORDING_CHUNK_MAGIC 0x4b4e4843 // "CHNK"
+
+struct RecordingHeader
+{
+  char magic[8];
+  // sizeof(RecordingHeader) of the writer
+  uint32_t headerSize;
+  uint32_t numChannels;
+  // 2 for sampl_t, 4 for lsampl_t
+  uint32_t sampleSize;
+  uint32_t maxdata;
+  double samplingRate;
+  double rangeMin;
+  double rangeMax;
+  uint32_t rangeUnit;
+  // scans per chunk, only the last chunk may be shorter
+  uint32_t chunkScans;
+  // file offset of the chunk index, 0 if the index is missing
+  uint64_t indexOffset;
+};
+
+struct RecordingChunk
+{
+  uint32_t magic;
+  uint32_t nScans;
+  // number of the first scan in this chunk since the start
+  uint64_t firstScan;
+};
+
+struct RecordingIndexEntry
+{
+  uint64_t firstScan;
+  uint64_t offset;
+};
+
+#endif
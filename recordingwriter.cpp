@@ -0,0 +1,206 @@
+/***************************************************************************
+ *   Copyright (C) 2003 by Matthias H. Hennig                              *
+ *   hennig@cn.stir.ac.uk                                                  *
+ *   Copyright (C) 2005 by Bernd Porr                                      *
+ *   mail@berndporr.me.uk                                                  *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#include "recordingwriter.h"
+
+#include <string.h>
+
+RecordingWriter::RecordingWriter(SampleSource *source) :
+    f(0),
+    scanSize(source->scanSize()),
+    current(0),
+    closing(false),
+    scanCount(0),
+    lost(0),
+    error(0)
+{
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, RECORDING_MAGIC, sizeof(header.magic));
+  header.headerSize = sizeof(header);
+  header.numChannels = source->numChannels();
+  header.sampleSize = source->isLsampl() ? sizeof(lsampl_t) : sizeof(sampl_t);
+  header.maxdata = source->maxData();
+  header.samplingRate = source->samplingRate();
+  header.rangeMin = source->range()->min;
+  header.rangeMax = source->range()->max;
+  header.rangeUnit = source->range()->unit;
+  header.chunkScans = RECORD_CHUNK_BYTES / scanSize;
+  if( header.chunkScans == 0 )
+    header.chunkScans = 1;
+
+  for(int i=0; i<RECORD_BUFFERS; i++)
+  {
+    chunks[i].data = new unsigned char[(size_t)header.chunkScans * scanSize];
+    chunks[i].nScans = 0;
+    chunks[i].firstScan = 0;
+    freeChunks.append(&chunks[i]);
+  }
+}
+
+RecordingWriter::~RecordingWriter()
+{
+  close();
+  for(int i=0; i<RECORD_BUFFERS; i++)
+    delete[] chunks[i].data;
+}
+
+bool RecordingWriter::open(const char *filename)
+{
+  if( (f = fopen(filename, "wb")) == 0 )
+  {
+    perror(filename);
+    return false;
+  }
+
+  // the index offset is filled in by close()
+  if( fwrite(&header, sizeof(header), 1, f) != 1 )
+  {
+    perror(filename);
+    fclose(f);
+    f = 0;
+    return false;
+  }
+
+  start();
+  return true;
+}
+
+void RecordingWriter::write(const void *raw, int nScans)
+{
+  const unsigned char *s = (const unsigned char *)raw;
+
+  while( nScans > 0 )
+  {
+    if( !current )
+    {
+      lock.lock();
+      if( !freeChunks.isEmpty() )
+        current = freeChunks.takeFirst();
+      lock.unlock();
+
+      if( !current )
+      {
+        // all buffers are waiting for the disk
+        lost.fetchAndAddRelaxed(nScans);
+        scanCount += nScans;
+        return;
+      }
+      current->nScans = 0;
+      current->firstScan = scanCount;
+    }
+
+    int n = header.chunkScans - current->nScans;
+    if( n > nScans )
+      n = nScans;
+
+    memcpy(current->data + (size_t)current->nScans * scanSize, s,
+	   (size_t)n * scanSize);
+    current->nScans += n;
+    scanCount += n;
+    s += (size_t)n * scanSize;
+    nScans -= n;
+
+    if( current->nScans == (int)header.chunkScans )
+    {
+      lock.lock();
+      fullChunks.append(current);
+      wakeup.wakeOne();
+      lock.unlock();
+      current = 0;
+    }
+  }
+}
+
+void RecordingWriter::writeChunk(const Chunk *chunk)
+{
+  if( failed() )
+    return;
+
+  RecordingChunk c;
+  c.magic = RECORDING_CHUNK_MAGIC;
+  c.nScans = chunk->nScans;
+  c.firstScan = chunk->firstScan;
+
+  RecordingIndexEntry entry;
+  entry.firstScan = chunk->firstScan;
+  entry.offset = ftello(f);
+
+  if( fwrite(&c, sizeof(c), 1, f) != 1 ||
+      fwrite(chunk->data, scanSize, chunk->nScans, f) != (size_t)chunk->nScans )
+  {
+    perror("writing recording");
+    error.storeRelease(1);
+    return;
+  }
+  index.append(entry);
+}
+
+void RecordingWriter::run()
+{
+  lock.lock();
+  for(;;)
+  {
+    while( fullChunks.isEmpty() && !closing )
+      wakeup.wait(&lock);
+    if( fullChunks.isEmpty() )
+      break;
+
+    Chunk *chunk = fullChunks.takeFirst();
+    lock.unlock();
+
+    writeChunk(chunk);
+
+    lock.lock();
+    freeChunks.append(chunk);
+  }
+  lock.unlock();
+}
+
+void RecordingWriter::close()
+{
+  if( !f )
+    return;
+
+  // write() must not be called any more, so the partial chunk is ours
+  lock.lock();
+  if( current && current->nScans > 0 )
+    fullChunks.append(current);
+  current = 0;
+  closing = true;
+  wakeup.wakeOne();
+  lock.unlock();
+  wait();
+
+  if( !failed() )
+  {
+    uint64_t nChunks = index.size();
+    header.indexOffset = ftello(f);
+    if( fwrite(&nChunks, sizeof(nChunks), 1, f) != 1 ||
+	fwrite(index.constData(), sizeof(RecordingIndexEntry), nChunks, f) != nChunks ||
+	fseeko(f, 0, SEEK_SET) != 0 ||
+	fwrite(&header, sizeof(header), 1, f) != 1 )
+    {
+      perror("writing recording index");
+      error.storeRelease(1);
+    }
+  }
+
+  if( fclose(f) != 0 )
+  {
+    perror("closing recording");
+    error.storeRelease(1);
+  }
+  f = 0;
+
+  if( lost.loadAcquire() )
+    fprintf(stderr, "recording: %d scans dropped\n", lost.loadAcquire());
+}
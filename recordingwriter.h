@@ -0,0 +1,105 @@
+/***************************************************************************
+ *   Copyright (C) 2003 by Matthias H. Hennig                              *
+ *   hennig@cn.stir.ac.uk                                                  *
+ *   Copyright (C) 2005 by Bernd Porr                                      *
+ *   mail@berndporr.me.uk                                                  *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#ifndef RECORDINGWRITER_H
+#define RECORDINGWRITER_H
+
+#include <stdio.h>
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QAtomicInt>
+#include <QList>
+#include <QVector>
+
+#include "samplesource.h"
+#include "recording.h"
+
+// size of one chunk in the file
+#define RECORD_CHUNK_BYTES (256*1024)
+// number of chunk buffers, this bounds the memory used
+#define RECORD_BUFFERS 16
+
+/**
+ * Streams raw scans to a recording (see recording.h) on its own thread.
+ * The acquisition thread copies its scans into one of a fixed pool of
+ * chunk buffers and full buffers are handed to the writer, so a slow
+ * disk can never stall the acquisition. If all buffers are waiting for
+ * the disk, scans are dropped and show up as a gap in the chunk's
+ * firstScan numbers.
+ **/
+class RecordingWriter : public QThread
+{
+public:
+
+  // takes the format of the scans from the source
+  RecordingWriter(SampleSource *source);
+  ~RecordingWriter();
+
+  /// creates the file and starts the writer, false on error
+  bool open(const char *filename);
+
+  /// called by the acquisition thread with raw scans from acquire()
+  void write(const void *raw, int nScans);
+
+  /// writes the remaining data and the index and closes the file
+  void close();
+
+  /// scans thrown away because the disk did not keep up
+  long int dropped() const { return lost.loadAcquire(); }
+
+  /// set if the file could not be written
+  bool failed() const { return error.loadAcquire() != 0; }
+
+protected:
+
+  virtual void run();
+
+private:
+
+  struct Chunk
+  {
+    unsigned char *data;
+    int nScans;
+    uint64_t firstScan;
+  };
+
+  void writeChunk(const Chunk *chunk);
+
+  FILE *f;
+  RecordingHeader header;
+  int scanSize;
+
+  Chunk chunks[RECORD_BUFFERS];
+  // the chunk being filled by write(), 0 if none was free
+  Chunk *current;
+
+  // hands chunks between the two threads
+  QMutex lock;
+  QWaitCondition wakeup;
+  QList<Chunk *> freeChunks;
+  QList<Chunk *> fullChunks;
+  bool closing;
+
+  // scans seen by write() so far, including dropped ones
+  uint64_t scanCount;
+  // written by write(), read by dropped() from the GUI thread
+  QAtomicInt lost;
+
+  // only touched by the writer thread
+  QVector<RecordingIndexEntry> index;
+
+  QAtomicInt error;
+};
+
+#endif
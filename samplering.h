@@ -0,0 +1,124 @@
+/***************************************************************************
+ *   Copyright (C) 2003 by Matthias H. Hennig                              *
+ *   hennig@cn.stir.ac.uk                                                  *
+ *   Copyright (C) 2005 by Bernd Porr                                      *
+ *   mail@berndporr.me.uk                                                  *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#ifndef SAMPLERING_H
+#define SAMPLERING_H
+
+#include <QAtomicInt>
+
+/**
+ * Lock-free single-producer/single-consumer ring of decoded scans.
+ * One scan holds one double per channel. The acquisition thread is the
+ * only writer and the GUI thread the only reader, so the two indices
+ * can be published with plain acquire/release operations.
+ **/
+class SampleRing
+{
+public:
+
+  // the capacity is rounded up to the next power of two
+  SampleRing(int numChannels, int capacityScans);
+  ~SampleRing();
+
+  int numChannels() const { return nChannels; }
+  int capacity() const { return (int)(mask + 1); }
+
+  /// producer side: copies up to nScans, returns the number written
+  int push(const double *scans, int nScans);
+
+  /// consumer side: number of scans waiting to be read
+  int readAvailable() const;
+
+  /// consumer side: pointer to the next contiguous run of scans
+  /// (stops at the wrap around), returns its length in scans
+  int peek(const double **scans) const;
+
+  /// consumer side: release scans obtained with peek()
+  void consume(int nScans);
+
+  /// scans thrown away because the consumer did not keep up
+  int overruns() const { return dropped.loadAcquire(); }
+
+private:
+  double *data;
+  int nChannels;
+  unsigned int mask;
+
+  // free running scan counters, only ever written by one side
+  QAtomicInt head;
+  QAtomicInt tail;
+  QAtomicInt dropped;
+};
+
+inline SampleRing::SampleRing(int numChannels, int capacityScans) :
+    nChannels(numChannels),
+    head(0),
+    tail(0),
+    dropped(0)
+{
+  unsigned int n = 1;
+  while( n < (unsigned int)capacityScans )
+    n <<= 1;
+  mask = n - 1;
+  data = new double[n * nChannels];
+}
+
+inline SampleRing::~SampleRing()
+{
+  delete[] data;
+}
+
+inline int SampleRing::push(const double *scans, int nScans)
+{
+  unsigned int h = (unsigned int)head.loadAcquire();
+  unsigned int t = (unsigned int)tail.loadAcquire();
+  int space = (int)(mask + 1 - (h - t));
+
+  if( nScans > space )
+  {
+    dropped.fetchAndAddRelaxed(nScans - space);
+    nScans = space;
+  }
+
+  for(int i=0; i<nScans; i++)
+  {
+    double *dst = data + ((h + i) & mask) * nChannels;
+    for(int c=0; c<nChannels; c++)
+      dst[c] = scans[i*nChannels + c];
+  }
+
+  head.storeRelease((int)(h + nScans));
+  return nScans;
+}
+
+inline int SampleRing::readAvailable() const
+{
+  return (int)((unsigned int)head.loadAcquire() -
+               (unsigned int)tail.loadAcquire());
+}
+
+inline int SampleRing::peek(const double **scans) const
+{
+  unsigned int t = (unsigned int)tail.loadAcquire();
+  int n = (int)((unsigned int)head.loadAcquire() - t);
+  int toWrap = (int)(mask + 1 - (t & mask));
+
+  *scans = data + (t & mask) * nChannels;
+  return n < toWrap ? n : toWrap;
+}
+
+inline void SampleRing::consume(int nScans)
+{
+  tail.storeRelease((int)((unsigned int)tail.loadAcquire() + nScans));
+}
+
+#endif
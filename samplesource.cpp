@@ -0,0 +1,86 @@
+/***************************************************************************
+ *   Copyright (C) 2003 by Matthias H. Hennig                              *
+ *   hennig@cn.stir.ac.uk                                                  *
+ *   Copyright (C) 2005 by Bernd Porr                                      *
+ *   mail@berndporr.me.uk                                                  *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#include "samplesource.h"
+
+void SampleSource::prepareDecoder()
+{
+  // 0 and maxdata are the ends of the range instead of NAN, for every
+  // source, a single NAN would stay in the VEP for good
+  comedi_set_global_oor_behavior(COMEDI_OOR_NUMBER);
+
+  low = comedi_to_phys(0, &crange, maxdata);
+  high = comedi_to_phys(maxdata, &crange, maxdata);
+
+  if( maxdata > DECODE_TABLE_MAX )
+  {
+    if( lsampl )
+      decoder = &SampleSource::decodeLinear<lsampl_t>;
+    else
+      decoder = &SampleSource::decodeLinear<sampl_t>;
+    return;
+  }
+
+  // comedi_to_phys() itself, so the result is the same to the bit.
+  // All 16 bit codes, a corrupt sample above maxdata is converted as
+  // before.
+  delete[] table;
+  table = new double[DECODE_TABLE_MAX + 1];
+  for(lsampl_t c=0; c<=DECODE_TABLE_MAX; c++)
+    table[c] = comedi_to_phys(c, &crange, maxdata);
+
+  if( lsampl )
+    decoder = &SampleSource::decodeTable<lsampl_t>;
+  else
+    decoder = &SampleSource::decodeTable<sampl_t>;
+}
+
+template<typename T>
+void SampleSource::decodeTable(const void *raw, int n, double *y)
+{
+  const T *s = (const T *)raw;
+  const double *t = table;
+
+  if( sizeof(T) == sizeof(sampl_t) )
+  {
+    // every code is in the table
+    for(int i=0; i<n; i++)
+      y[i] = t[s[i]];
+    return;
+  }
+
+  for(int i=0; i<n; i++)
+  {
+    lsampl_t c = s[i];
+    y[i] = c <= DECODE_TABLE_MAX ? t[c] : comedi_to_phys(c, &crange, maxdata);
+  }
+}
+
+template<typename T>
+void SampleSource::decodeLinear(const void *raw, int n, double *y)
+{
+  const T *s = (const T *)raw;
+  double m = maxdata;
+  double span = crange.max - crange.min;
+  double min = crange.min;
+
+  for(int i=0; i<n; i++)
+  {
+    lsampl_t c = s[i];
+    if( c == 0 )
+      y[i] = low;
+    else if( c == maxdata )
+      y[i] = high;
+    else
+      y[i] = (double)c / m * span + min;
+  }
+}
@@ -0,0 +1,122 @@
+/***************************************************************************
+ *   Copyright (C) 2003 by Matthias H. Hennig                              *
+ *   hennig@cn.stir.ac.uk                                                  *
+ *   Copyright (C) 2005 by Bernd Porr                                      *
+ *   mail@berndporr.me.uk                                                  *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#ifndef SAMPLESOURCE_H
+#define SAMPLESOURCE_H
+
+#include <comedilib.h>
+
+// how long acquire() waits for new data before giving up (ms)
+#define ACQ_POLL_TIMEOUT 100
+
+// boards up to this maxdata are decoded with a table of all codes
+#define DECODE_TABLE_MAX 65535
+
+/**
+ * Where the raw scans come from: a comedi device, a recorded file or a
+ * generator. Scans are handed out in the device's own format (sampl_t
+ * or lsampl_t per channel) together with what is needed to convert
+ * them to volts, so all sources share one decoder.
+ **/
+class SampleSource
+{
+public:
+
+  SampleSource() :
+      nChannels(0),
+      rate(0),
+      lsampl(false),
+      maxdata(0),
+      decoder(0),
+      table(0)
+  {
+    crange.min = 0;
+    crange.max = 0;
+    crange.unit = UNIT_volt;
+  }
+
+  virtual ~SampleSource() { delete[] table; }
+
+  /// prepares and starts the source, returns 0 on success. The
+  /// properties below are valid afterwards.
+  virtual int open() = 0;
+
+  /**
+   * Waits up to ACQ_POLL_TIMEOUT ms for new data. On success *data
+   * points to whole scans which stay valid until release() is called.
+   * Returns the number of scans (at most maxScans), 0 if nothing
+   * arrived and -1 on errors or at the end of the data.
+   **/
+  virtual int acquire(const void **data, int maxScans) = 0;
+
+  /// hands back the scans obtained with acquire()
+  virtual void release(int nScans) = 0;
+
+  /// true if acquire() failed because there is no more data
+  virtual bool atEnd() const { return false; }
+
+  /// bytes waiting in the device buffer and its size, -1 and 0 if the
+  /// source has no such buffer
+  virtual int bufferContents() { return -1; }
+  virtual int bufferSize() const { return 0; }
+
+  int numChannels() const { return nChannels; }
+  double samplingRate() const { return rate; }
+  // true for 32 bit samples (lsampl_t), false for sampl_t
+  bool isLsampl() const { return lsampl; }
+  lsampl_t maxData() const { return maxdata; }
+  comedi_range *range() { return &crange; }
+
+  int scanSize() const
+  {
+    return nChannels * (lsampl ? sizeof(lsampl_t) : sizeof(sampl_t));
+  }
+
+  /// converts nScans raw scans from acquire() to volts, exactly as
+  /// comedi_to_phys() would
+  void decode(const void *raw, int nScans, double *scans)
+  {
+    if( !decoder )
+      prepareDecoder();
+    (this->*decoder)(raw, nScans * nChannels, scans);
+  }
+
+  /// picks the conversion for the format of the source, done by the
+  /// first decode() if not before. The properties must not change
+  /// afterwards.
+  void prepareDecoder();
+
+protected:
+
+  int nChannels;
+  double rate;
+  bool lsampl;
+  lsampl_t maxdata;
+  comedi_range crange;
+
+private:
+
+  // n samples of type T looked up in the table
+  template<typename T> void decodeTable(const void *raw, int n, double *y);
+  // n samples of type T converted with the same arithmetic as
+  // comedi_to_phys(), for boards with more than 16 bits
+  template<typename T> void decodeLinear(const void *raw, int n, double *y);
+
+  void (SampleSource::*decoder)(const void *raw, int n, double *y);
+
+  // volts of every code up to DECODE_TABLE_MAX
+  double *table;
+  // comedi_to_phys() of 0 and maxdata, which may be NAN
+  double low, high;
+};
+
+#endif
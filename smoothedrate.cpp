@@ -0,0 +1,194 @@
+/***************************************************************************
+ *   Copyright (C) 2003 by Matthias H. Hennig                              *
+ *   hennig@cn.stir.ac.uk                                                  *
+ *   Copyright (C) 2005 by Bernd Porr                                      *
+ *   mail@berndporr.me.uk                                                  *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#include "smoothedrate.h"
+
+#include <math.h>
+#include <string.h>
+
+void gaussianFilter(const double *x, double *y, int n, double sigma)
+{
+  if( sigma < 0.5 )
+  {
+    memmove(y, x, n * sizeof(double));
+    return;
+  }
+
+  // Young and van Vliet, "Recursive implementation of the Gaussian
+  // filter", Signal Processing 44 (1995)
+  double q;
+  if( sigma >= 2.5 )
+    q = 0.98711 * sigma - 0.96330;
+  else
+    q = 3.97156 - 4.14554 * sqrt(1 - 0.26891 * sigma);
+  double q2 = q * q;
+  double q3 = q2 * q;
+  double b0 = 1.57825 + 2.44413 * q + 1.4281 * q2 + 0.422205 * q3;
+  double b1 = (2.44413 * q + 2.85619 * q2 + 1.26661 * q3) / b0;
+  double b2 = -(1.4281 * q2 + 1.26661 * q3) / b0;
+  double b3 = 0.422205 * q3 / b0;
+  double B = 1 - (b1 + b2 + b3);
+
+  // forwards, then backwards, zero outside the sweep
+  double w1 = 0, w2 = 0, w3 = 0;
+  for(int i=0; i<n; i++)
+  {
+    double w = B * x[i] + b1 * w1 + b2 * w2 + b3 * w3;
+    y[i] = w;
+    w3 = w2;
+    w2 = w1;
+    w1 = w;
+  }
+  w1 = w2 = w3 = 0;
+  for(int i=n-1; i>=0; i--)
+  {
+    double w = B * y[i] + b1 * w1 + b2 * w2 + b3 * w3;
+    y[i] = w;
+    w3 = w2;
+    w2 = w1;
+    w1 = w;
+  }
+}
+
+void exponentialFilter(const double *x, double *y, int n, double tau)
+{
+  // the kernel (1-a) a^k sums to one
+  double a = tau > 0 ? exp(-1 / tau) : 0;
+  double v = 0;
+  for(int i=0; i<n; i++)
+  {
+    v = a * v + (1 - a) * x[i];
+    y[i] = v;
+  }
+}
+
+SmoothedRate::SmoothedRate(const PsthProcessor *processor, int train) :
+    processor(processor),
+    train(train),
+    step(1),
+    lastStep(1),
+    nPoints(0),
+    count(0),
+    weight(0),
+    timeData(0),
+    rateData(0),
+    done(0)
+{
+  reset();
+}
+
+SmoothedRate::~SmoothedRate()
+{
+  delete[] count;
+  delete[] weight;
+  delete[] timeData;
+  delete[] rateData;
+}
+
+void SmoothedRate::setTrain(int t)
+{
+  train = t;
+  reset();
+}
+
+void SmoothedRate::reset()
+{
+  step = (int)(RATE_RESOLUTION_MS * processor->rate() / 1000 + 0.5);
+  if( step < 1 )
+    step = 1;
+  int length = processor->sweepSamples();
+  nPoints = (length + step - 1) / step;
+  lastStep = length - (nPoints - 1) * step;
+
+  delete[] count;
+  delete[] weight;
+  delete[] timeData;
+  delete[] rateData;
+  count = new double[nPoints];
+  weight = new double[nPoints];
+  timeData = new double[nPoints];
+  rateData = new double[nPoints];
+
+  int pre = processor->preTriggerSamples();
+  for(int i=0; i<nPoints; i++)
+  {
+    count[i] = 0;
+    rateData[i] = 0;
+    timeData[i] = (i * step - pre) * 1000.0 / processor->rate();
+  }
+  done = 0;
+}
+
+bool SmoothedRate::update()
+{
+  long int running = processor->runningTrial();
+  if( running <= done )
+    return false;
+
+  const SpikeArena &spikes = processor->spikes(train);
+  long int length = processor->sweepSamples();
+  for(; done<running; done++)
+  {
+    long int start = processor->trialStart(done);
+    for(long int i=spikes.lowerBound(start); i<spikes.size(); i++)
+    {
+      long int offset = (long int)spikes[i] - start;
+      if( offset >= length )
+	break;
+      count[offset / step] += 1;
+    }
+  }
+
+  smooth();
+  return true;
+}
+
+void SmoothedRate::smooth()
+{
+  // counts per point and trial to spikes/s
+  double norm = processor->rate() / ((double)step * done);
+  double width = processor->smoothingWidth() / step;
+
+  // the part of the kernel inside the sweep, so the rate does not
+  // drop towards the ends; the last point only covers lastStep samples
+  for(int i=0; i<nPoints; i++)
+    weight[i] = 1;
+  if( nPoints > 0 )
+    weight[nPoints - 1] = (double)lastStep / step;
+
+  switch( done ? processor->smoothingKernel() : KERNEL_NONE )
+  {
+  case KERNEL_GAUSSIAN:
+    gaussianFilter(count, rateData, nPoints, width);
+    gaussianFilter(weight, weight, nPoints, width);
+    break;
+  case KERNEL_EXPONENTIAL:
+    exponentialFilter(count, rateData, nPoints, width);
+    exponentialFilter(weight, weight, nPoints, width);
+    break;
+  default:
+    for(int i=0; i<nPoints; i++)
+      rateData[i] = 0;
+    return;
+  }
+
+  for(int i=0; i<nPoints; i++)
+    rateData[i] *= norm / weight[i];
+}
+
+double SmoothedRate::at(int offset) const
+{
+  int i = offset / step;
+  if( i >= nPoints )
+    i = nPoints - 1;
+  return i < 0 ? 0 : rateData[i];
+}
@@ -0,0 +1,93 @@
+/***************************************************************************
+ *   Copyright (C) 2003 by Matthias H. Hennig                              *
+ *   hennig@cn.stir.ac.uk                                                  *
+ *   Copyright (C) 2005 by Bernd Porr                                      *
+ *   mail@berndporr.me.uk                                                  *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#ifndef SMOOTHEDRATE_H
+#define SMOOTHEDRATE_H
+
+#include "psthprocessor.h"
+
+// spacing of the points of the smoothed rate in ms, at least a sample
+#define RATE_RESOLUTION_MS 1
+
+/**
+ * Firing rate of one spike train smoothed with the processor's kernel
+ * (see PsthProcessor::setSmoothing()) instead of binned. The spikes of
+ * every trial which has ended are counted once into a fine histogram,
+ * which is then filtered: the Gaussian with the recursive filter of
+ * Young and van Vliet forwards and backwards, the exponential causally
+ * with a first order filter. Near the ends of the sweep the rate is
+ * divided by the part of the kernel inside it, where a short last
+ * point counts by its width. Both cost the same for any kernel width,
+ * so an update is proportional to the sweep length plus the new
+ * spikes. Running trials are left out.
+ **/
+class SmoothedRate
+{
+public:
+
+  SmoothedRate(const PsthProcessor *processor, int train = 0);
+  ~SmoothedRate();
+
+  /// starts over with another train of the processor
+  void setTrain(int train);
+
+  /// starts over, after the parameters or the data have changed. The
+  /// buffers are reallocated, the pointers below become invalid.
+  void reset();
+
+  /// counts the trials which have ended since the last call and
+  /// smooths again, returns false if there were none
+  bool update();
+
+  /// smooths the counts again, after the kernel has changed
+  void smooth();
+
+  /// number of points
+  int length() const { return nPoints; }
+  /// time of each point in ms, relative to the trigger
+  const double *time() const { return timeData; }
+  /// spikes/s, zero without a kernel or before the first trial ended
+  const double *rate() const { return rateData; }
+  /// rate at a sample offset in the sweep
+  double at(int offset) const;
+
+  /// trials in the rate
+  long int trials() const { return done; }
+
+private:
+
+  const PsthProcessor *processor;
+  int train;
+
+  // samples per point, the last one may be shorter
+  int step;
+  int lastStep;
+  int nPoints;
+
+  // spikes per point of all counted trials
+  double *count;
+  // the kernel filtered ones, to correct the ends
+  double *weight;
+  double *timeData;
+  double *rateData;
+
+  // trials before this one are counted
+  long int done;
+};
+
+/// y = x convolved with a Gaussian of sigma points, x and y may be the same
+void gaussianFilter(const double *x, double *y, int n, double sigma);
+
+/// y = x convolved with a causal exponential of tau points
+void exponentialFilter(const double *x, double *y, int n, double tau);
+
+#endif
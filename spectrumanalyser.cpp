@@ -0,0 +1,150 @@
+/***************************************************************************
+ *   Copyright (C) 2003 by Matthias H. Hennig                              *
+ *   hennig@cn.stir.ac.uk                                                  *
+ *   Copyright (C) 2005 by Bernd Porr                                      *
+ *   mail@berndporr.me.uk                                                  *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#include "spectrumanalyser.h"
+
+#include <math.h>
+#include <string.h>
+
+// set in the middle index when the spectrum there is new
+#define FRESH 4
+
+SpectrumAnalyser::SpectrumAnalyser(double samplingRate) :
+    rate(samplingRate),
+    clearRequest(0),
+    total(0),
+    back(0),
+    front(2),
+    middle(1),
+    running(0)
+{
+  segment = 4;
+  while( segment < rate / PSD_RESOLUTION )
+    segment <<= 1;
+  nFreq = segment / 2 + 1;
+
+  // a few updates worth of samples, in case the thread is late
+  ring = new SampleRing(1, (int)(4 * rate * PSD_UPDATE_PERIOD / 1000) + 1);
+
+  histLen = segment * (PSD_SEGMENTS + 1) / 2;
+  history = new double[histLen];
+
+  fft = new RealFft(segment);
+  window = new double[segment];
+  windowPower = 0;
+  for(int i=0; i<segment; i++)
+  {
+    window[i] = 0.5 - 0.5 * cos(2 * M_PI * i / segment);
+    windowPower += window[i] * window[i];
+  }
+  seg = new double[segment];
+  re = new double[nFreq];
+  im = new double[nFreq];
+
+  for(int b=0; b<3; b++)
+  {
+    buffers[b] = new double[nFreq];
+    memset(buffers[b], 0, nFreq * sizeof(double));
+  }
+}
+
+SpectrumAnalyser::~SpectrumAnalyser()
+{
+  stop();
+  wait();
+  delete ring;
+  delete[] history;
+  delete fft;
+  delete[] window;
+  delete[] seg;
+  delete[] re;
+  delete[] im;
+  for(int b=0; b<3; b++)
+    delete[] buffers[b];
+}
+
+bool SpectrumAnalyser::takeSpectrum()
+{
+  if( !(middle.loadAcquire() & FRESH) )
+    return false;
+  front = middle.fetchAndStoreAcqRel(front) & ~FRESH;
+  return true;
+}
+
+void SpectrumAnalyser::run()
+{
+  while( running.loadAcquire() )
+  {
+    // short naps, so that stop() does not have to wait long
+    for(int t=0; t<PSD_UPDATE_PERIOD && running.loadAcquire(); t+=50)
+      msleep(50);
+    analyse();
+  }
+}
+
+void SpectrumAnalyser::analyse()
+{
+  // everything before the request belongs to the old channel
+  bool cleared = clearRequest.fetchAndStoreAcquire(0);
+  if( cleared )
+    total = 0;
+
+  long int before = total;
+  const double *y;
+  int n;
+  while( (n = ring->peek(&y)) > 0 )
+  {
+    if( !cleared )
+    {
+      for(int i=0; i<n; i++)
+	history[(total + i) % histLen] = y[i];
+      total += n;
+    }
+    ring->consume(n);
+  }
+  if( total == before || total < segment )
+    return;
+
+  long int have = total < histLen ? total : histLen;
+  int nSeg = (int)((have - segment) / (segment / 2)) + 1;
+  if( nSeg > PSD_SEGMENTS )
+    nSeg = PSD_SEGMENTS;
+
+  double *psd = buffers[back];
+  memset(psd, 0, nFreq * sizeof(double));
+
+  // the latest segments, each one half a segment before the next
+  for(int s=0; s<nSeg; s++)
+  {
+    long int start = total - segment - (long int)s * (segment / 2);
+    double mean = 0;
+    for(int i=0; i<segment; i++)
+    {
+      seg[i] = history[(start + i) % histLen];
+      mean += seg[i];
+    }
+    mean /= segment;
+    for(int i=0; i<segment; i++)
+      seg[i] = (seg[i] - mean) * window[i];
+
+    fft->transform(seg, re, im);
+    for(int k=0; k<nFreq; k++)
+      psd[k] += re[k] * re[k] + im[k] * im[k];
+  }
+
+  // one sided, only DC and Nyquist are there once
+  double scale = 1 / (rate * windowPower * nSeg);
+  for(int k=0; k<nFreq; k++)
+    psd[k] *= (k == 0 || k == nFreq - 1) ? scale : 2 * scale;
+
+  back = middle.fetchAndStoreAcqRel(back | FRESH) & ~FRESH;
+}
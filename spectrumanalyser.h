@@ -0,0 +1,112 @@
+/***************************************************************************
+ *   Copyright (C) 2003 by Matthias H. Hennig                              *
+ *   hennig@cn.stir.ac.uk                                                  *
+ *   Copyright (C) 2005 by Bernd Porr                                      *
+ *   mail@berndporr.me.uk                                                  *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#ifndef SPECTRUMANALYSER_H
+#define SPECTRUMANALYSER_H
+
+#include <QThread>
+#include <QAtomicInt>
+
+#include "samplering.h"
+#include "fft.h"
+
+// frequency resolution in Hz, the segments are the next power of two
+// of samples above the sampling rate divided by this
+#define PSD_RESOLUTION 1
+// segments averaged for one spectrum, overlapping by half
+#define PSD_SEGMENTS 8
+// ms between two spectra
+#define PSD_UPDATE_PERIOD 500
+
+/**
+ * Welch power spectral density of one channel on its own thread. The
+ * GUI pushes the samples it shows, the thread takes them every
+ * PSD_UPDATE_PERIOD ms, averages the Hann windowed periodograms of the
+ * last PSD_SEGMENTS half overlapping segments and hands the spectrum
+ * back through a triple buffer. Neither side ever waits for the other
+ * and everything is allocated in the constructor.
+ **/
+class SpectrumAnalyser : public QThread
+{
+public:
+
+  SpectrumAnalyser(double samplingRate);
+  ~SpectrumAnalyser();
+
+  /// starts the thread, stop() may come before it actually runs
+  void start()
+  {
+    running.storeRelease(1);
+    QThread::start();
+  }
+
+  /// ask the thread to finish, returns without waiting
+  void stop() { running.storeRelease(0); }
+
+  /// GUI side: samples of the channel, in order
+  void push(const double *y, int n) { ring->push(y, n); }
+
+  /// GUI side: forget the samples so far, e.g. for another channel
+  void clear() { clearRequest.storeRelease(1); }
+
+  /// GUI side: makes the latest spectrum the one returned by
+  /// spectrum(), false if there is none since the last call
+  bool takeSpectrum();
+
+  /// power in V^2/Hz from DC to the Nyquist frequency
+  const double *spectrum() const { return buffers[front]; }
+  int numFrequencies() const { return nFreq; }
+  /// in Hz
+  double frequency(int k) const { return k * rate / segment; }
+
+protected:
+
+  virtual void run();
+
+private:
+
+  // takes the new samples and works out a spectrum if there are any
+  void analyse();
+
+  double rate;
+  // samples per segment
+  int segment;
+  int nFreq;
+
+  // filled by the GUI thread
+  SampleRing *ring;
+  QAtomicInt clearRequest;
+
+  // the last histLen samples, the newest at (total-1) % histLen
+  double *history;
+  int histLen;
+  long int total;
+
+  RealFft *fft;
+  double *window;
+  // sum of the squared window
+  double windowPower;
+  double *seg;
+  double *re;
+  double *im;
+
+  // three spectra: the thread writes to back, the GUI reads front and
+  // middle is swapped between them with FRESH set when it is new
+  double *buffers[3];
+  int back;
+  int front;
+  QAtomicInt middle;
+
+  QAtomicInt running;
+};
+
+#endif
@@ -0,0 +1,61 @@
+/***************************************************************************
+ *   Copyright (C) 2003 by Matthias H. Hennig                              *
+ *   hennig@cn.stir.ac.uk                                                  *
+ *   Copyright (C) 2005 by Bernd Porr                                      *
+ *   mail@berndporr.me.uk                                                  *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#include "spectrumplot.h"
+
+#include <qwt/qwt_scale_engine.h>
+
+#include <math.h>
+
+SpectrumPlot::SpectrumPlot(const SpectrumAnalyser *analyser, QWidget *parent) :
+    QwtPlot(parent),
+    analyser(analyser)
+{
+  setTitle("Power spectrum");
+  setAxisTitle(QwtPlot::xBottom, "Frequency/Hz");
+  setAxisTitle(QwtPlot::yLeft, "dB V^2/Hz");
+  setAxisScaleEngine(QwtPlot::xBottom, new QwtLogScaleEngine);
+
+  nPoints = analyser->numFrequencies() - 1;
+  xData = new double[nPoints];
+  yData = new double[nPoints];
+  for(int k=0; k<nPoints; k++)
+  {
+    xData[k] = analyser->frequency(k + 1);
+    yData[k] = SPECTRUM_FLOOR_DB;
+  }
+  setAxisScale(QwtPlot::xBottom, xData[0], xData[nPoints - 1]);
+
+  curve = new QwtPlotCurve("PSD");
+  curve->setPen( QPen(Qt::blue, 1) );
+  curve->setRawSamples(xData, yData, nPoints);
+  curve->attach(this);
+
+  setAutoReplot(false);
+}
+
+SpectrumPlot::~SpectrumPlot()
+{
+  delete[] xData;
+  delete[] yData;
+}
+
+void SpectrumPlot::refresh()
+{
+  const double *p = analyser->spectrum();
+  for(int k=0; k<nPoints; k++)
+  {
+    double db = p[k + 1] > 0 ? 10 * log10(p[k + 1]) : SPECTRUM_FLOOR_DB;
+    yData[k] = db < SPECTRUM_FLOOR_DB ? SPECTRUM_FLOOR_DB : db;
+  }
+  replot();
+}
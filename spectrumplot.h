@@ -0,0 +1,51 @@
+/***************************************************************************
+ *   Copyright (C) 2003 by Matthias H. Hennig                              *
+ *   hennig@cn.stir.ac.uk                                                  *
+ *   Copyright (C) 2005 by Bernd Porr                                      *
+ *   mail@berndporr.me.uk                                                  *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#ifndef SPECTRUMPLOT_H
+#define SPECTRUMPLOT_H
+
+#include <qwt/qwt_plot.h>
+#include <qwt/qwt_plot_curve.h>
+
+#include "spectrumanalyser.h"
+
+// lowest power shown, in dB re 1 V^2/Hz, so that empty bins do not
+// stretch the axis
+#define SPECTRUM_FLOOR_DB -200
+
+/**
+ * The power spectrum from a SpectrumAnalyser in dB over a logarithmic
+ * frequency axis, so that the mains and its harmonics are as easy to
+ * see at high sampling rates as at low ones. DC is left out.
+ **/
+class SpectrumPlot : public QwtPlot
+{
+public:
+
+  SpectrumPlot(const SpectrumAnalyser *analyser, QWidget *parent = 0);
+  ~SpectrumPlot();
+
+  /// shows the analyser's current spectrum
+  void refresh();
+
+private:
+
+  const SpectrumAnalyser *analyser;
+  QwtPlotCurve *curve;
+
+  // frequency and power of bins 1 up to Nyquist
+  int nPoints;
+  double *xData;
+  double *yData;
+};
+
+#endif
@@ -0,0 +1,110 @@
+/***************************************************************************
+ *   Copyright (C) 2003 by Matthias H. Hennig                              *
+ *   hennig@cn.stir.ac.uk                                                  *
+ *   Copyright (C) 2005 by Bernd Porr                                      *
+ *   mail@berndporr.me.uk                                                  *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#ifndef SPIKEARENA_H
+#define SPIKEARENA_H
+
+#include <stdint.h>
+#include <string.h>
+
+// events per block of the arena
+#define SPIKE_BLOCK_EVENTS 16384
+
+/**
+ * Append-only list of spike times (in samples since the PSTH was
+ * started) for one channel. The trial and the offset within the trial
+ * follow from the sweep length, so the PSTH can be rebuilt for any
+ * sweep length or bin width. The events live in fixed size blocks
+ * which never move once allocated: another thread may read the first
+ * size() events through a copy of the block pointers while new ones
+ * are appended.
+ **/
+class SpikeArena
+{
+public:
+
+  SpikeArena() :
+      blocks(0),
+      nBlocks(0),
+      maxBlocks(0),
+      n(0)
+  {}
+
+  ~SpikeArena()
+  {
+    clear();
+    delete[] blocks;
+  }
+
+  void append(uint64_t time)
+  {
+    if( n == (long int)nBlocks * SPIKE_BLOCK_EVENTS )
+      grow();
+    blocks[n / SPIKE_BLOCK_EVENTS][n % SPIKE_BLOCK_EVENTS] = time;
+    n++;
+  }
+
+  long int size() const { return n; }
+  uint64_t operator[](long int i) const
+  {
+    return blocks[i / SPIKE_BLOCK_EVENTS][i % SPIKE_BLOCK_EVENTS];
+  }
+
+  /// index of the first event at or after time, size() if none
+  long int lowerBound(uint64_t time) const
+  {
+    long int lo = 0, hi = n;
+    while( lo < hi )
+    {
+      long int mid = (lo + hi) / 2;
+      if( (*this)[mid] < time )
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+    return lo;
+  }
+  int numBlocks() const { return nBlocks; }
+  const uint64_t *block(int i) const { return blocks[i]; }
+
+  /// frees all events, nobody may be reading them
+  void clear()
+  {
+    for(int i=0; i<nBlocks; i++)
+      delete[] blocks[i];
+    nBlocks = 0;
+    n = 0;
+  }
+
+private:
+
+  void grow()
+  {
+    if( nBlocks == maxBlocks )
+    {
+      maxBlocks = maxBlocks ? 2*maxBlocks : 16;
+      uint64_t **b = new uint64_t*[maxBlocks];
+      if( nBlocks )
+        memcpy(b, blocks, nBlocks * sizeof(uint64_t *));
+      delete[] blocks;
+      blocks = b;
+    }
+    blocks[nBlocks++] = new uint64_t[SPIKE_BLOCK_EVENTS];
+  }
+
+  uint64_t **blocks;
+  int nBlocks;
+  int maxBlocks;
+  long int n;
+};
+
+#endif
@@ -0,0 +1,153 @@
+/***************************************************************************
+ *   Copyright (C) 2003 by Matthias H. Hennig                              *
+ *   hennig@cn.stir.ac.uk                                                  *
+ *   Copyright (C) 2005 by Bernd Porr                                      *
+ *   mail@berndporr.me.uk                                                  *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#include "spikedetector.h"
+
+#include <stdint.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+int detectCrossingsScalar(const double *y, int n, double thres,
+			  bool *detected, int *crossings)
+{
+  bool d = *detected;
+  int count = 0;
+
+  for(int i=0; i<n; i++)
+  {
+    if( !d && y[i]>thres )
+    {
+      crossings[count++] = i;
+      d = true;
+    }
+    else if( y[i] < thres )
+    {
+      d = false;
+    }
+  }
+
+  *detected = d;
+  return count;
+}
+
+#ifdef HAVE_X86_SIMD
+
+// bit i of *above/*below is set if y[i] is above/below thres, 64 samples
+typedef void (*MaskFunction)(const double *y, double thres,
+			     uint64_t *above, uint64_t *below);
+
+__attribute__((target("avx")))
+static void masksAvx(const double *y, double thres,
+		     uint64_t *above, uint64_t *below)
+{
+  __m256d t = _mm256_set1_pd(thres);
+  uint64_t a = 0, b = 0;
+
+  for(int i=0; i<64; i+=4)
+  {
+    __m256d v = _mm256_loadu_pd(y + i);
+    a |= (uint64_t)_mm256_movemask_pd(_mm256_cmp_pd(v, t, _CMP_GT_OQ)) << i;
+    b |= (uint64_t)_mm256_movemask_pd(_mm256_cmp_pd(v, t, _CMP_LT_OQ)) << i;
+  }
+
+  *above = a;
+  *below = b;
+}
+
+__attribute__((target("sse2")))
+static void masksSse2(const double *y, double thres,
+		      uint64_t *above, uint64_t *below)
+{
+  __m128d t = _mm_set1_pd(thres);
+  uint64_t a = 0, b = 0;
+
+  for(int i=0; i<64; i+=2)
+  {
+    __m128d v = _mm_loadu_pd(y + i);
+    a |= (uint64_t)_mm_movemask_pd(_mm_cmpgt_pd(v, t)) << i;
+    b |= (uint64_t)_mm_movemask_pd(_mm_cmplt_pd(v, t)) << i;
+  }
+
+  *above = a;
+  *below = b;
+}
+
+static MaskFunction selectMasks()
+{
+  __builtin_cpu_init();
+  if( __builtin_cpu_supports("avx") )
+    return masksAvx;
+  if( __builtin_cpu_supports("sse2") )
+    return masksSse2;
+  return 0;
+}
+
+static const MaskFunction masks = selectMasks();
+
+int detectCrossings(const double *y, int n, double thres,
+		    bool *detected, int *crossings)
+{
+  if( !masks )
+    return detectCrossingsScalar(y, n, thres, detected, crossings);
+
+  bool d = *detected;
+  int count = 0;
+  int i = 0;
+
+  for(; i+64<=n; i+=64)
+  {
+    uint64_t above, below;
+    masks(y + i, thres, &above, &below);
+
+    if( (above | below) != ~(uint64_t)0 )
+    {
+      // a sample equal to the threshold (or NaN) leaves the state
+      // alone, which the masks cannot express
+      int m = detectCrossingsScalar(y + i, 64, thres, &d, crossings + count);
+      for(int k=0; k<m; k++)
+        crossings[count + k] += i;
+      count += m;
+      continue;
+    }
+
+    // every sample is above or below, so the state before a sample is
+    // whether the previous one was above
+    uint64_t spikes = above & ~((above << 1) | (uint64_t)d);
+    while( spikes )
+    {
+      crossings[count++] = i + __builtin_ctzll(spikes);
+      spikes &= spikes - 1;
+    }
+    d = above >> 63;
+  }
+
+  int m = detectCrossingsScalar(y + i, n - i, thres, &d, crossings + count);
+  for(int k=0; k<m; k++)
+    crossings[count + k] += i;
+  count += m;
+
+  *detected = d;
+  return count;
+}
+
+#else
+
+int detectCrossings(const double *y, int n, double thres,
+		    bool *detected, int *crossings)
+{
+  return detectCrossingsScalar(y, n, thres, detected, crossings);
+}
+
+#endif
@@ -0,0 +1,34 @@
+/***************************************************************************
+ *   Copyright (C) 2003 by Matthias H. Hennig                              *
+ *   hennig@cn.stir.ac.uk                                                  *
+ *   Copyright (C) 2005 by Bernd Porr                                      *
+ *   mail@berndporr.me.uk                                                  *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#ifndef SPIKEDETECTOR_H
+#define SPIKEDETECTOR_H
+
+/**
+ * Finds the upward threshold crossings in a block of n samples of one
+ * channel and writes their indices to crossings (room for n needed).
+ * A spike is a sample above thres while *detected is false. It sets
+ * *detected, which is cleared again by the next sample below thres, so
+ * the state carries over to the next block. Returns the number of
+ * crossings.
+ *
+ * Blocks of 64 samples are compared with AVX or SSE2 into bit masks if
+ * the CPU supports it, everything else is done sample by sample.
+ **/
+int detectCrossings(const double *y, int n, double thres,
+		    bool *detected, int *crossings);
+
+/// the same, one sample at a time
+int detectCrossingsScalar(const double *y, int n, double thres,
+			  bool *detected, int *crossings);
+
+#endif
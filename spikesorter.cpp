@@ -0,0 +1,376 @@
+/***************************************************************************
+ *   Copyright (C) 2003 by Matthias H. Hennig                              *
+ *   hennig@cn.stir.ac.uk                                                  *
+ *   Copyright (C) 2005 by Bernd Porr                                      *
+ *   mail@berndporr.me.uk                                                  *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#include "spikesorter.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+double sumSquaredErrorScalar(const double *a, const double *b, int n)
+{
+  double sum = 0;
+  for(int i=0; i<n; i++)
+  {
+    double d = a[i] - b[i];
+    sum += d * d;
+  }
+  return sum;
+}
+
+#ifdef HAVE_X86_SIMD
+
+typedef double (*ErrorFunction)(const double *a, const double *b, int n);
+
+__attribute__((target("avx")))
+static double errorAvx(const double *a, const double *b, int n)
+{
+  __m256d sum = _mm256_setzero_pd();
+  int i = 0;
+  for(; i+4<=n; i+=4)
+  {
+    __m256d d = _mm256_sub_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i));
+    sum = _mm256_add_pd(sum, _mm256_mul_pd(d, d));
+  }
+
+  double s[4];
+  _mm256_storeu_pd(s, sum);
+  return s[0] + s[1] + s[2] + s[3] +
+    sumSquaredErrorScalar(a + i, b + i, n - i);
+}
+
+__attribute__((target("sse2")))
+static double errorSse2(const double *a, const double *b, int n)
+{
+  __m128d sum = _mm_setzero_pd();
+  int i = 0;
+  for(; i+2<=n; i+=2)
+  {
+    __m128d d = _mm_sub_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i));
+    sum = _mm_add_pd(sum, _mm_mul_pd(d, d));
+  }
+
+  double s[2];
+  _mm_storeu_pd(s, sum);
+  return s[0] + s[1] + sumSquaredErrorScalar(a + i, b + i, n - i);
+}
+
+static ErrorFunction selectError()
+{
+  __builtin_cpu_init();
+  if( __builtin_cpu_supports("avx") )
+    return errorAvx;
+  if( __builtin_cpu_supports("sse2") )
+    return errorSse2;
+  return sumSquaredErrorScalar;
+}
+
+static const ErrorFunction squaredError = selectError();
+
+double sumSquaredError(const double *a, const double *b, int n)
+{
+  return squaredError(a, b, n);
+}
+
+#else
+
+double sumSquaredError(const double *a, const double *b, int n)
+{
+  return sumSquaredErrorScalar(a, b, n);
+}
+
+#endif
+
+SpikeSorter::SpikeSorter(int numChannels, double samplingRate, int maxBlock) :
+    nChannels(numChannels),
+    maxBlock(maxBlock)
+{
+  snipLength = (int)(SNIPPET_MS * samplingRate / 1000 + 0.5);
+  if( snipLength < SNIPPET_MIN_LENGTH )
+    snipLength = SNIPPET_MIN_LENGTH;
+  snipPre = (int)(SNIPPET_PRE_MS * samplingRate / 1000 + 0.5);
+  if( snipPre < snipLength / 4 )
+    snipPre = snipLength / 4;
+  stride = (snipLength + 3) & ~3;
+
+  templates = new double[nChannels * SORT_MAX_UNITS * stride];
+  maxError = new double[nChannels * SORT_MAX_UNITS];
+  nUnits = new int[nChannels];
+  memset(templates, 0, nChannels * SORT_MAX_UNITS * stride * sizeof(double));
+  for(int c=0; c<nChannels; c++)
+    nUnits[c] = 0;
+
+  // the oldest queued snippet starts at most snipLength samples before
+  // the block
+  histLen = snipLength + maxBlock;
+  history = new double[nChannels * histLen];
+
+  // crossings are at least two samples apart
+  queueLen = snipLength + maxBlock;
+  queue = new long int[nChannels * queueLen];
+  queueHead = new long int[nChannels];
+  queueTail = new long int[nChannels];
+
+  pool = new double[nChannels * SNIPPET_POOL * stride];
+  poolUnits = new int[nChannels * SNIPPET_POOL];
+  poolCount = new long int[nChannels];
+
+  doneTimes = new long int[queueLen];
+  doneUnits = new int[queueLen];
+
+  reset();
+}
+
+SpikeSorter::~SpikeSorter()
+{
+  delete[] templates;
+  delete[] maxError;
+  delete[] nUnits;
+  delete[] history;
+  delete[] queue;
+  delete[] queueHead;
+  delete[] queueTail;
+  delete[] pool;
+  delete[] poolUnits;
+  delete[] poolCount;
+  delete[] doneTimes;
+  delete[] doneUnits;
+}
+
+void SpikeSorter::reset()
+{
+  memset(history, 0, nChannels * histLen * sizeof(double));
+  // the padding has to stay zero
+  memset(pool, 0, nChannels * SNIPPET_POOL * stride * sizeof(double));
+  for(int c=0; c<nChannels; c++)
+  {
+    queueHead[c] = 0;
+    queueTail[c] = 0;
+    poolCount[c] = 0;
+  }
+}
+
+int SpikeSorter::addTemplate(int channel, const double *shape, double tolerance)
+{
+  int u = nUnits[channel];
+  if( u == SORT_MAX_UNITS )
+    return UNIT_REJECTED;
+
+  double *t = templates + (channel*SORT_MAX_UNITS + u)*stride;
+  memcpy(t, shape, snipLength * sizeof(double));
+  // compared with the summed squared error of a whole snippet
+  maxError[channel*SORT_MAX_UNITS + u] = tolerance * tolerance * snipLength;
+  nUnits[channel]++;
+  return u;
+}
+
+void SpikeSorter::clearTemplates(int channel)
+{
+  nUnits[channel] = 0;
+}
+
+double SpikeSorter::tolerance(int channel, int unit) const
+{
+  return sqrt(maxError[channel*SORT_MAX_UNITS + unit] / snipLength);
+}
+
+int SpikeSorter::classify(int channel, const double *snippet) const
+{
+  int best = UNIT_REJECTED;
+  double bestError = 0;
+
+  for(int u=0; u<nUnits[channel]; u++)
+  {
+    double e = sumSquaredError(snippet, shape(channel, u), stride);
+    if( e <= maxError[channel*SORT_MAX_UNITS + u] &&
+	(best == UNIT_REJECTED || e < bestError) )
+    {
+      best = u;
+      bestError = e;
+    }
+  }
+  return best;
+}
+
+int SpikeSorter::process(int channel, const double *y, int n,
+			 const int *crossings, int nCrossings, long int time)
+{
+  if( n > maxBlock )
+    n = maxBlock;
+
+  // the row goes into the ring in at most two pieces
+  double *h = history + channel*histLen;
+  int at = time % histLen;
+  int k = n < histLen - at ? n : histLen - at;
+  memcpy(h + at, y, k * sizeof(double));
+  memcpy(h, y + k, (n - k) * sizeof(double));
+
+  long int *q = queue + channel*queueLen;
+  for(int i=0; i<nCrossings; i++)
+  {
+    long int t = time + crossings[i];
+    // not enough data before the very first samples
+    if( t >= snipPre )
+      q[queueHead[channel]++ % queueLen] = t;
+  }
+
+  int nDone = 0;
+  long int end = time + n;
+  while( queueTail[channel] != queueHead[channel] )
+  {
+    long int t = q[queueTail[channel] % queueLen];
+    long int start = t - snipPre;
+    if( start + snipLength > end )
+      break;
+
+    int slot = channel*SNIPPET_POOL + poolCount[channel] % SNIPPET_POOL;
+    double *s = pool + slot*stride;
+    for(int i=0; i<snipLength; i++)
+      s[i] = h[(start + i) % histLen];
+
+    int unit = nUnits[channel] ? classify(channel, s) : UNIT_REJECTED;
+    poolUnits[slot] = unit;
+    poolCount[channel]++;
+
+    doneTimes[nDone] = t;
+    doneUnits[nDone] = unit;
+    nDone++;
+    queueTail[channel]++;
+  }
+
+  return nDone;
+}
+
+int SpikeSorter::numSnippets(int channel) const
+{
+  return poolCount[channel] < SNIPPET_POOL ? poolCount[channel] : SNIPPET_POOL;
+}
+
+const double *SpikeSorter::snippet(int channel, int i) const
+{
+  int slot = (poolCount[channel] - 1 - i) % SNIPPET_POOL;
+  return pool + (channel*SNIPPET_POOL + slot)*stride;
+}
+
+int SpikeSorter::snippetUnit(int channel, int i) const
+{
+  int slot = (poolCount[channel] - 1 - i) % SNIPPET_POOL;
+  return poolUnits[channel*SNIPPET_POOL + slot];
+}
+
+int SpikeSorter::average(int channel, int n, double *shape, double *rms) const
+{
+  if( n > numSnippets(channel) )
+    n = numSnippets(channel);
+
+  for(int i=0; i<snipLength; i++)
+    shape[i] = 0;
+  *rms = 0;
+  if( n == 0 )
+    return 0;
+
+  for(int k=0; k<n; k++)
+  {
+    const double *s = snippet(channel, k);
+    for(int i=0; i<snipLength; i++)
+      shape[i] += s[i];
+  }
+  for(int i=0; i<snipLength; i++)
+    shape[i] /= n;
+
+  double e = 0;
+  for(int k=0; k<n; k++)
+    e += sumSquaredErrorScalar(snippet(channel, k), shape, snipLength);
+  *rms = sqrt(e / ((double)n * snipLength));
+  return n;
+}
+
+bool SpikeSorter::saveTemplates(const char *filename) const
+{
+  FILE *f = fopen(filename, "w");
+  if( !f )
+  {
+    perror(filename);
+    return false;
+  }
+
+  for(int c=0; c<nChannels; c++)
+    for(int u=0; u<nUnits[c]; u++)
+    {
+      fprintf(f, "%d\t%g", c, tolerance(c, u));
+      const double *t = shape(c, u);
+      for(int i=0; i<snipLength; i++)
+	fprintf(f, "\t%g", t[i]);
+      fprintf(f, "\n");
+    }
+
+  return fclose(f) == 0;
+}
+
+bool SpikeSorter::loadTemplates(const char *filename)
+{
+  FILE *f = fopen(filename, "r");
+  if( !f )
+  {
+    perror(filename);
+    return false;
+  }
+
+  for(int c=0; c<nChannels; c++)
+    clearTemplates(c);
+
+  double *t = new double[snipLength];
+  char *line = 0;
+  size_t size = 0;
+  while( getline(&line, &size, f) > 0 )
+  {
+    char *p = line;
+    char *next;
+    int c = (int)strtol(p, &next, 10);
+    if( next == p || c < 0 || c >= nChannels )
+      continue;
+    p = next;
+    double tol = strtod(p, &next);
+    if( next == p )
+      continue;
+    p = next;
+
+    int i = 0;
+    for(; i<snipLength; i++)
+    {
+      t[i] = strtod(p, &next);
+      if( next == p )
+	break;
+      p = next;
+    }
+    // the rest of the line has to be empty
+    strtod(p, &next);
+    if( i < snipLength || next != p )
+    {
+      fprintf(stderr, "%s: template of channel %d is not %d samples long\n",
+	      filename, c, snipLength);
+      continue;
+    }
+    addTemplate(c, t, tol);
+  }
+
+  free(line);
+  delete[] t;
+  fclose(f);
+  return true;
+}
@@ -0,0 +1,144 @@
+/***************************************************************************
+ *   Copyright (C) 2003 by Matthias H. Hennig                              *
+ *   hennig@cn.stir.ac.uk                                                  *
+ *   Copyright (C) 2005 by Bernd Porr                                      *
+ *   mail@berndporr.me.uk                                                  *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#ifndef SPIKESORTER_H
+#define SPIKESORTER_H
+
+// templates (units) per channel
+#define SORT_MAX_UNITS 4
+
+// snippets kept per channel, the oldest one is overwritten
+#define SNIPPET_POOL 256
+
+// snippet length and the part of it before the crossing in ms, but
+// at least SNIPPET_MIN_LENGTH samples
+#define SNIPPET_MS 1.5
+#define SNIPPET_PRE_MS 0.5
+#define SNIPPET_MIN_LENGTH 8
+
+// the unit of a snippet which matches no template
+#define UNIT_REJECTED -1
+
+/**
+ * Sum of (a[i]-b[i])^2 over n samples, with AVX or SSE2 if the CPU
+ * supports it.
+ **/
+double sumSquaredError(const double *a, const double *b, int n);
+
+/// the same, one sample at a time
+double sumSquaredErrorScalar(const double *a, const double *b, int n);
+
+/**
+ * Cuts a waveform snippet around every threshold crossing out of the
+ * sample rows and assigns it to the template (unit) with the smallest
+ * squared error. A snippet which is further than the tolerance from
+ * every template of its channel is rejected.
+ *
+ * A snippet is only complete some samples after its crossing, so the
+ * crossings wait in a queue and the last samples of every channel are
+ * kept in a ring. The finished snippets go to a pool of the last
+ * SNIPPET_POOL per channel. Everything is allocated in the
+ * constructor, nothing on the way through process().
+ **/
+class SpikeSorter
+{
+public:
+
+  /// process() gets rows of up to maxBlock samples
+  SpikeSorter(int numChannels, double samplingRate, int maxBlock);
+  ~SpikeSorter();
+
+  /// snippet length in samples
+  int length() const { return snipLength; }
+  /// samples of a snippet before the crossing
+  int preSamples() const { return snipPre; }
+
+  /// adds a template of length() samples, returns its unit or
+  /// UNIT_REJECTED if the channel has SORT_MAX_UNITS already.
+  /// tolerance is the largest RMS difference in V which still matches.
+  int addTemplate(int channel, const double *shape, double tolerance);
+  void clearTemplates(int channel);
+  int numUnits(int channel) const { return nUnits[channel]; }
+  const double *shape(int channel, int unit) const
+  {
+    return templates + (channel*SORT_MAX_UNITS + unit)*stride;
+  }
+  /// RMS tolerance of a template in V
+  double tolerance(int channel, int unit) const;
+
+  /// the closest unit of a snippet, or UNIT_REJECTED
+  int classify(int channel, const double *snippet) const;
+
+  /// forgets the queued crossings and the snippets
+  void reset();
+
+  /// takes one row of n samples of a channel starting at sample time
+  /// and its crossings. Returns the number of snippets completed by
+  /// it, their crossing times and units are in sortedTimes() and
+  /// sortedUnits() until the next call.
+  int process(int channel, const double *y, int n,
+	      const int *crossings, int nCrossings, long int time);
+  const long int *sortedTimes() const { return doneTimes; }
+  const int *sortedUnits() const { return doneUnits; }
+
+  /// snippets in the pool of a channel
+  int numSnippets(int channel) const;
+  /// snippet i of a channel, 0 is the latest
+  const double *snippet(int channel, int i) const;
+  int snippetUnit(int channel, int i) const;
+
+  /// averages the last n snippets of a channel into shape, returns
+  /// how many there were. rms is their RMS difference from the mean.
+  int average(int channel, int n, double *shape, double *rms) const;
+
+  /// one template per line: channel, tolerance and the samples.
+  /// Templates of the wrong length are skipped.
+  bool saveTemplates(const char *filename) const;
+  bool loadTemplates(const char *filename);
+
+private:
+
+  int nChannels;
+  int maxBlock;
+  int snipLength;
+  int snipPre;
+  // snippets and templates are padded with zeros to a multiple of 4
+  int stride;
+
+  // per channel: SORT_MAX_UNITS templates and their squared tolerance
+  // times the length
+  double *templates;
+  double *maxError;
+  int *nUnits;
+
+  // per channel: the last histLen samples, indexed by time % histLen
+  double *history;
+  int histLen;
+
+  // per channel: crossing times waiting for their samples
+  long int *queue;
+  int queueLen;
+  long int *queueHead;
+  long int *queueTail;
+
+  // per channel: SNIPPET_POOL snippets, their units and the number of
+  // snippets ever added
+  double *pool;
+  int *poolUnits;
+  long int *poolCount;
+
+  // results of process()
+  long int *doneTimes;
+  int *doneUnits;
+};
+
+#endif
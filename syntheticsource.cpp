@@ -0,0 +1,172 @@
+/***************************************************************************
+ *   Copyright (C) 2003 by Matthias H. Hennig                              *
+ *   hennig@cn.stir.ac.uk                                                  *
+ *   Copyright (C) 2005 by Bernd Porr                                      *
+ *   mail@berndporr.me.uk                                                  *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#include "syntheticsource.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+static double now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+SyntheticSource::SyntheticSource(int numChannels, double samplingRate,
+				 double spikeRate, bool realtime,
+				 uint64_t seed) :
+    spikeRate(spikeRate),
+    realtime(realtime),
+    rng(seed ? seed : 1),
+    block(0),
+    waveform(0),
+    waveformLength(0),
+    nextSpike(0),
+    spikePos(0),
+    startTime(0),
+    delivered(0)
+{
+  nChannels = numChannels;
+  rate = samplingRate;
+  lsampl = false;
+  maxdata = 65535;
+  crange.min = -4;
+  crange.max = 4;
+  crange.unit = UNIT_volt;
+}
+
+SyntheticSource::~SyntheticSource()
+{
+  delete[] block;
+  delete[] waveform;
+  delete[] nextSpike;
+  delete[] spikePos;
+}
+
+double SyntheticSource::uniform()
+{
+  // xorshift64*
+  rng ^= rng >> 12;
+  rng ^= rng << 25;
+  rng ^= rng >> 27;
+  uint64_t r = rng * 2685821657736338717ULL;
+  return ((r >> 11) + 1) * (1.0 / 9007199254740992.0);
+}
+
+double SyntheticSource::gauss()
+{
+  // Box-Muller, the second value is thrown away
+  return sqrt(-2 * log(uniform())) * cos(2 * M_PI * uniform());
+}
+
+long int SyntheticSource::interval()
+{
+  if( spikeRate <= 0 )
+    return -1;
+  return (long int)ceil(-log(uniform()) * rate / spikeRate);
+}
+
+int SyntheticSource::open()
+{
+  if( nChannels < 1 || rate <= 0 )
+  {
+    fprintf(stderr, "synthetic source: invalid channel count or rate\n");
+    return -1;
+  }
+
+  block = new sampl_t[SYNTH_BLOCK_SCANS * nChannels];
+
+  // a biphasic spike of 2ms
+  waveformLength = (int)(rate * 0.002);
+  if( waveformLength < 2 )
+    waveformLength = 2;
+  waveform = new double[waveformLength];
+  for(int i=0; i<waveformLength; i++)
+  {
+    double x = (i + 0.5) / waveformLength;
+    double s = sin(2 * M_PI * x);
+    waveform[i] = SYNTH_SPIKE_AMPLITUDE * (x < 0.5 ? s : 0.5 * s);
+  }
+
+  nextSpike = new long int[nChannels];
+  spikePos = new int[nChannels];
+  for(int c=0; c<nChannels; c++)
+  {
+    nextSpike[c] = interval();
+    spikePos[c] = -1;
+  }
+
+  startTime = now();
+  return 0;
+}
+
+int SyntheticSource::acquire(const void **data, int maxScans)
+{
+  int nScans = SYNTH_BLOCK_SCANS;
+  if( nScans > maxScans )
+    nScans = maxScans;
+
+  if( realtime )
+  {
+    // hand out about 10ms at a time, like a device would
+    int slice = (int)(rate / 100) + 1;
+    if( nScans > slice )
+      nScans = slice;
+
+    double wait = (delivered + nScans) / rate - (now() - startTime);
+    if( wait > 0 )
+      usleep((useconds_t)(wait * 1e6));
+  }
+
+  double scale = maxdata / (crange.max - crange.min);
+  sampl_t *s = block;
+
+  for(int i=0; i<nScans; i++)
+  {
+    for(int c=0; c<nChannels; c++)
+    {
+      if( nextSpike[c] == 0 )
+      {
+        spikePos[c] = 0;
+        nextSpike[c] = interval();
+      }
+      if( nextSpike[c] > 0 )
+        nextSpike[c]--;
+
+      double v = SYNTH_NOISE * gauss();
+      if( spikePos[c] >= 0 )
+      {
+        v += waveform[spikePos[c]++];
+        if( spikePos[c] == waveformLength )
+          spikePos[c] = -1;
+      }
+
+      double raw = (v - crange.min) * scale + 0.5;
+      if( raw < 0 )
+        raw = 0;
+      if( raw > maxdata )
+        raw = maxdata;
+      *s++ = (sampl_t)raw;
+    }
+  }
+
+  *data = block;
+  return nScans;
+}
+
+void SyntheticSource::release(int nScans)
+{
+  delivered += nScans;
+}
@@ -0,0 +1,71 @@
+/***************************************************************************
+ *   Copyright (C) 2003 by Matthias H. Hennig                              *
+ *   hennig@cn.stir.ac.uk                                                  *
+ *   Copyright (C) 2005 by Bernd Porr                                      *
+ *   mail@berndporr.me.uk                                                  *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+#ifndef SYNTHETICSOURCE_H
+#define SYNTHETICSOURCE_H
+
+#include <stdint.h>
+
+#include "samplesource.h"
+
+// scans generated per call
+#define SYNTH_BLOCK_SCANS 4096
+
+// noise standard deviation and spike peak in volts
+#define SYNTH_NOISE 0.1
+#define SYNTH_SPIKE_AMPLITUDE 2.0
+
+/**
+ * Generates independent Poisson spike trains plus Gaussian noise on
+ * every channel, as 16 bit samples in a +/-4V range. The same seed
+ * always gives the same data, so runs can be compared.
+ **/
+class SyntheticSource : public SampleSource
+{
+public:
+
+  SyntheticSource(int numChannels, double samplingRate, double spikeRate,
+		  bool realtime = true, uint64_t seed = 1);
+  ~SyntheticSource();
+
+  virtual int open();
+  virtual int acquire(const void **data, int maxScans);
+  virtual void release(int nScans);
+
+private:
+
+  // uniform in (0,1]
+  double uniform();
+  double gauss();
+  // samples until the next spike
+  long int interval();
+
+  double spikeRate;
+  bool realtime;
+  uint64_t rng;
+
+  sampl_t *block;
+
+  // spike waveform, one value per sample
+  double *waveform;
+  int waveformLength;
+
+  // per channel: samples to the next spike onset and position in the
+  // waveform of the spike being played (-1 if none)
+  long int *nextSpike;
+  int *spikePos;
+
+  double startTime;
+  long int delivered;
+};
+
+#endif
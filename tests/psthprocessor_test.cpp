@@ -0,0 +1,100 @@
+/***************************************************************************
+ *   Copyright (C) 2003 by Matthias H. Hennig                              *
+ *   hennig@cn.stir.ac.uk                                                  *
+ *   Copyright (C) 2005 by Bernd Porr                                      *
+ *   mail@berndporr.me.uk                                                  *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+// Checks that stopping the PSTH freezes it: more data after stop() and
+// then a change of the bin width or sweep length, which rebuilds the
+// PSTH from the spike times, must give back the same values, free
+// running and triggered. Returns non-zero on a mismatch.
+
+#include "../psthprocessor.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define CHANNELS 2
+#define RATE 10000
+// in samples
+#define SWEEP 1000
+#define BINW 50
+
+static int failures = 0;
+
+// random spikes on channel 0, a sync pulse every 1.3 sweeps on 1
+static void feed(PsthProcessor *p, long int *clock, int blocks)
+{
+  double scans[PROC_BLOCK_SCANS * CHANNELS];
+  for(int b=0; b<blocks; b++)
+  {
+    for(int n=0; n<PROC_BLOCK_SCANS; n++, (*clock)++)
+    {
+      scans[n*CHANNELS] = rand() % 200 == 0 ? 3 : 0;
+      scans[n*CHANNELS + 1] = *clock % (SWEEP * 13 / 10) < 10 ? 5 : 0;
+    }
+    for(int done=0; done<PROC_BLOCK_SCANS; )
+      done += p->process(scans + done*CHANNELS, PROC_BLOCK_SCANS - done);
+  }
+}
+
+static void check(bool triggered)
+{
+  PsthProcessor p(CHANNELS, RATE);
+  p.setPsthLength(SWEEP);
+  p.setBinWidth(BINW);
+  p.setThreshold(1);
+  if( triggered )
+    p.setTrigger(1, TRIGGER_LEVEL, 0);
+  p.start();
+
+  long int clock = 0;
+  srand(1);
+  feed(&p, &clock, 200);
+  p.stop();
+
+  int nBins = p.numBins();
+  double *before = new double[nBins];
+  for(int i=0; i<nBins; i++)
+    before[i] = p.psth(0)[i];
+
+  // sweeps which are not recorded, then a rebuild with the same bins
+  feed(&p, &clock, 200);
+  p.setBinWidth(2 * BINW);
+  p.setBinWidth(BINW);
+  p.finishRebuild();
+  p.setPsthLength(2 * SWEEP);
+  p.setPsthLength(SWEEP);
+  p.finishRebuild();
+
+  for(int i=0; i<nBins; i++)
+    if( fabs(p.psth(0)[i] - before[i]) > 1e-9 * fabs(before[i]) )
+    {
+      if( failures++ < 10 )
+	fprintf(stderr, "%s: bin %d is %g after the rebuild, was %g\n",
+		triggered ? "triggered" : "free running", i, p.psth(0)[i],
+		before[i]);
+    }
+  delete[] before;
+}
+
+int main()
+{
+  check(false);
+  check(true);
+
+  if( failures )
+  {
+    fprintf(stderr, "%d mismatches\n", failures);
+    return 1;
+  }
+  printf("the PSTH stays the same after stop() and a rebuild\n");
+  return 0;
+}
@@ -0,0 +1,125 @@
+/***************************************************************************
+ *   Copyright (C) 2003 by Matthias H. Hennig                              *
+ *   hennig@cn.stir.ac.uk                                                  *
+ *   Copyright (C) 2005 by Bernd Porr                                      *
+ *   mail@berndporr.me.uk                                                  *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ ***************************************************************************/
+
+// Checks that detectCrossings() finds exactly the same crossings and
+// leaves the same state as detectCrossingsScalar(), on random blocks
+// with samples at the threshold, NaNs, short tails and the state
+// carried from block to block. Returns non-zero on a mismatch.
+
+#include "../spikedetector.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// longest block, several 64 sample words and a tail
+#define MAX_BLOCK 300
+// samples pushed through in random pieces
+#define STREAM_SAMPLES 1000000
+
+static int failures = 0;
+
+// below, above, at the threshold or NaN, with runs so that spikes last
+// a few samples
+static void fill(double *y, int n, double thres)
+{
+  int kind = rand() % 4;
+  for(int i=0; i<n; i++)
+  {
+    if( rand() % 4 == 0 )
+      kind = rand() % 16;
+    switch( kind )
+    {
+    case 0:
+      y[i] = thres;
+      break;
+    case 1:
+      y[i] = NAN;
+      break;
+    case 2:
+    case 3:
+    case 4:
+    case 5:
+    case 6:
+      y[i] = thres + 1 + rand() % 100;
+      break;
+    default:
+      y[i] = thres - 1 - rand() % 100;
+    }
+  }
+}
+
+// both detectors on the same block, starting in the same state
+static void compare(const double *y, int n, double thres,
+		    bool *fast, bool *slow, const char *what)
+{
+  int a[MAX_BLOCK], b[MAX_BLOCK];
+  int na = detectCrossings(y, n, thres, fast, a);
+  int nb = detectCrossingsScalar(y, n, thres, slow, b);
+
+  bool same = na == nb && *fast == *slow;
+  for(int k=0; same && k<na; k++)
+    same = a[k] == b[k];
+  if( same )
+    return;
+
+  if( failures++ < 10 )
+    fprintf(stderr, "%s: %d samples, %d crossings instead of %d, state %d instead of %d\n",
+	    what, n, na, nb, *fast, *slow);
+  // carry on from the right state
+  *fast = *slow;
+}
+
+int main()
+{
+  double y[MAX_BLOCK];
+  srand(1);
+
+  // single blocks of every length up to MAX_BLOCK in both states
+  for(int n=0; n<=MAX_BLOCK; n++)
+    for(int r=0; r<200; r++)
+    {
+      double thres = (rand() % 2000 - 1000) / 100.0;
+      fill(y, n, thres);
+      bool start = rand() % 2;
+      bool fast = start, slow = start;
+      compare(y, n, thres, &fast, &slow, "block");
+    }
+
+  // whole words above or below, the masks without the scalar fallback
+  for(int r=0; r<1000; r++)
+  {
+    for(int i=0; i<128; i++)
+      y[i] = (rand() % 3 == 0) ? 1 : -1;
+    bool start = rand() % 2;
+    bool fast = start, slow = start;
+    compare(y, 128, 0, &fast, &slow, "words");
+  }
+
+  // one stream in random pieces, the state goes from piece to piece
+  bool fast = false, slow = false;
+  for(long int done=0; done<STREAM_SAMPLES; )
+  {
+    int n = rand() % (MAX_BLOCK + 1);
+    fill(y, n, 0.5);
+    compare(y, n, 0.5, &fast, &slow, "stream");
+    done += n;
+  }
+
+  if( failures )
+  {
+    fprintf(stderr, "%d mismatches\n", failures);
+    return 1;
+  }
+  printf("detectCrossings matches detectCrossingsScalar\n");
+  return 0;
+}